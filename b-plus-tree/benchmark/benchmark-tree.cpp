@@ -96,6 +96,32 @@ namespace BPlusTree
 		}
 	}
 
+	BENCHMARK_DEFINE_F(TreeBenchmark, PayloadBatch)
+	(benchmark::State& state)
+	{
+		Configure(state.range(0), state.range(1), (BenchmarkStorageAdapterType)state.range(2));
+		const auto batch = 16;
+
+		vector<pair<number, bytes>> data;
+		for (number i = 0; i < COUNT; i++)
+		{
+			data.push_back({i, random(BLOCK_SIZE - 4 * sizeof(number))});
+		}
+
+		tree = make_unique<Tree>(move(storage), data);
+
+		for (auto _ : state)
+		{
+			vector<number> keys;
+			for (auto i = 0; i < batch; i++)
+			{
+				keys.push_back(rand() % COUNT);
+			}
+			vector<vector<bytes>> returned;
+			tree->search(keys, returned);
+		}
+	}
+
 	BENCHMARK_REGISTER_F(TreeBenchmark, PayloadSinglePath)
 		->Args({64, 100000, StorageAdapterTypeInMemory})
 		->Args({128, 100000, StorageAdapterTypeInMemory})
@@ -117,6 +143,18 @@ namespace BPlusTree
 		->Args({128, 100000, StorageAdapterTypeFileSystem})
 		->Args({256, 100000, StorageAdapterTypeFileSystem})
 
+		->Iterations(1 << 10)
+		->Unit(benchmark::kMicrosecond);
+
+	BENCHMARK_REGISTER_F(TreeBenchmark, PayloadBatch)
+		->Args({64, 100000, StorageAdapterTypeInMemory})
+		->Args({128, 100000, StorageAdapterTypeInMemory})
+		->Args({256, 100000, StorageAdapterTypeInMemory})
+
+		->Args({64, 100000, StorageAdapterTypeFileSystem})
+		->Args({128, 100000, StorageAdapterTypeFileSystem})
+		->Args({256, 100000, StorageAdapterTypeFileSystem})
+
 		->Iterations(1 << 10)
 		->Unit(benchmark::kMicrosecond);
 }
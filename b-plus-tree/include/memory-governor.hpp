@@ -0,0 +1,147 @@
+#pragma once
+
+#include "definitions.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace BPlusTree
+{
+	using namespace std;
+
+	/**
+	 * @brief A memory consumer whose size can be controlled by the MemoryGovernor
+	 *
+	 * Implementations must be safe to call concurrently with their regular use.
+	 */
+	class GovernedCache
+	{
+		public:
+		/**
+		 * @brief gives the amount of memory the cache currently holds
+		 *
+		 * @return number the size in bytes
+		 */
+		virtual number memoryUsage() const = 0;
+
+		/**
+		 * @brief gives the cumulative benefit of the cache (e.g. the number of hits)
+		 *
+		 * The governor only looks at how much it grows between the rebalances.
+		 *
+		 * @return number the benefit so far
+		 */
+		virtual number benefit() const = 0;
+
+		/**
+		 * @brief sets the amount of memory the cache may hold, evicting if it holds more
+		 *
+		 * @param budget the size in bytes
+		 */
+		virtual void setBudget(number budget) = 0;
+
+		virtual ~GovernedCache() = 0;
+	};
+
+	/**
+	 * @brief Enforces a single memory budget across many caches (of many trees) in a process
+	 *
+	 * The budget, less the fixed reservations (e.g. the pinned levels), is split between the attached caches:
+	 * each gets an equal share of MIN_SHARE of it, and the rest is split in proportion to their recent benefit
+	 * (smoothed over the rebalances).
+	 * The caches that do not help get shrunk, the ones that do get the memory.
+	 *
+	 * The caches are held weakly, a destroyed cache is forgotten.
+	 */
+	class MemoryGovernor
+	{
+		public:
+		/**
+		 * @brief Construct a new Memory Governor object
+		 *
+		 * @param budget the total size in bytes
+		 */
+		MemoryGovernor(number budget);
+
+		/**
+		 * @brief Destroy the Memory Governor object (stops the background rebalancing)
+		 *
+		 */
+		~MemoryGovernor();
+
+		/**
+		 * @brief puts the cache under the governor and rebalances
+		 *
+		 * @param cache the cache to govern
+		 */
+		void attach(shared_ptr<GovernedCache> cache);
+
+		/**
+		 * @brief reserves the memory that is not evictable (e.g. Tree::pinnedSize), so that the caches get less
+		 *
+		 * @param bytes the size in bytes
+		 */
+		void reserve(number bytes);
+
+		/**
+		 * @brief returns the previously reserved memory
+		 *
+		 * @param bytes the size in bytes
+		 */
+		void release(number bytes);
+
+		/**
+		 * @brief recomputes the budgets of the caches from their recent benefit and applies them
+		 *
+		 */
+		void rebalance();
+
+		/**
+		 * @brief starts rebalancing in the background every period
+		 *
+		 * @param period the time between the rebalances
+		 */
+		void start(chrono::milliseconds period);
+
+		/**
+		 * @brief gives the total memory held by the caches plus the reservations
+		 *
+		 * @return number the size in bytes
+		 */
+		number usage() const;
+
+		private:
+		/**
+		 * @brief an attached cache and what is known about its benefit
+		 *
+		 */
+		struct Governed
+		{
+			weak_ptr<GovernedCache> cache;
+			number lastBenefit;
+			double recentBenefit;
+		};
+
+		// the fraction of the budget split equally, regardless of the benefit
+		static inline const double MIN_SHARE = 0.2;
+
+		number budget;
+		number reserved = 0;
+
+		mutable mutex lock;
+		vector<Governed> caches;
+
+		thread rebalancer;
+		condition_variable rebalancerStop;
+		bool stopping = false;
+
+		/**
+		 * @brief same as rebalance, with the lock held
+		 *
+		 */
+		void rebalanceLocked();
+	};
+}
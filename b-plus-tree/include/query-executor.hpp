@@ -0,0 +1,133 @@
+#pragma once
+
+#include "definitions.h"
+#include "thread-pool.hpp"
+#include "tree.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace BPlusTree
+{
+	using namespace std;
+
+	/**
+	 * @brief A query to run by the executor
+	 *
+	 * A point query has start equal to end.
+	 */
+	struct Query
+	{
+		/**
+		 * @brief the inclusive lower range endpoint
+		 *
+		 */
+		number start;
+
+		/**
+		 * @brief the inclusive upper range endpoint
+		 *
+		 */
+		number end;
+	};
+
+	/**
+	 * @brief The outcome of a query run by the executor
+	 *
+	 */
+	struct QueryResult
+	{
+		/**
+		 * @brief the data corresponding to the query (same as the search would return)
+		 *
+		 */
+		vector<bytes> response;
+
+		/**
+		 * @brief the time from the batch submission until the query's last chunk completed
+		 *
+		 */
+		chrono::nanoseconds latency;
+	};
+
+	/**
+	 * @brief Runs batches of point and range queries against a tree on a work-stealing pool of threads
+	 *
+	 * The point lookups are in a queue of their own that every worker checks first.
+	 * Range queries are split into chunks (at the inner node separators, see Tree::splitKeys) spread across the workers,
+	 * and each chunk is scanned a page of SCAN_PAGE records at a time (see Tree::resume), the rest queued again.
+	 * So a point lookup waits for a page at most, however long the scans dealt before it.
+	 * Each worker takes the chunks from its own queue and, once it is empty, steals from the others.
+	 * The workers are persistent (a ThreadPool), the batches are run one at a time.
+	 */
+	class QueryExecutor
+	{
+		public:
+		/**
+		 * @brief Construct a new Query Executor object
+		 *
+		 * @param threads the number of worker threads (at least one)
+		 */
+		QueryExecutor(number threads);
+
+		/**
+		 * @brief runs the batch of queries and waits for all of them to complete
+		 *
+		 * @param tree the tree to query
+		 * @param queries the batch of queries
+		 * @param options the search parameters (same for all queries)
+		 * @return vector<QueryResult> the result of each query (in the order of queries)
+		 */
+		vector<QueryResult> run(const Tree &tree, const vector<Query> &queries, const SearchOptions &options = SearchOptions());
+
+		private:
+		number threads;
+
+		// a batch runs a worker loop on each of the threads
+		ThreadPool pool;
+		// serializes the batches
+		mutex runLock;
+
+		// the number of records a scan task reads before it yields to the other tasks
+		static inline const number SCAN_PAGE = 256;
+
+		/**
+		 * @brief a unit of work: a chunk of a query
+		 *
+		 */
+		struct Task
+		{
+			number query;
+			number chunk;
+			number start;
+			number end;
+			// the continuation token of the chunk scanned so far (empty before the first page)
+			bytes token;
+		};
+
+		/**
+		 * @brief the queue of tasks of a single worker
+		 *
+		 */
+		struct WorkerQueue
+		{
+			mutex lock;
+			deque<Task> tasks;
+		};
+
+		/**
+		 * @brief takes the next task for the worker: the oldest point lookup,
+		 * or the oldest chunk of its own, or the newest chunk of another worker
+		 *
+		 * @param points the queue of the point lookups
+		 * @param queues the queues of all workers
+		 * @param worker the index of the worker
+		 * @param task the task taken
+		 * @return true if a task was taken
+		 * @return false if all queues are empty
+		 */
+		static bool take(WorkerQueue &points, vector<WorkerQueue> &queues, number worker, Task &task);
+	};
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "definitions.h"
+#include "memory-governor.hpp"
+
+#include <list>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+
+namespace BPlusTree
+{
+	using namespace std;
+
+	/**
+	 * @brief The identity of a cached search: start, end, payload offset, payload length and the limit of records
+	 *
+	 */
+	using ResultKey = tuple<number, number, number, number, number>;
+
+	/**
+	 * @brief Cache of decoded search results under a byte budget
+	 *
+	 * Entries are evicted in LRU order.
+	 * Admission is controlled by TinyLFU: the access frequencies of all keys (cached or not) are approximated
+	 * with a count-min sketch, and a new entry is admitted only if it is accessed more often than the entries it would evict.
+	 * This way one-off queries do not push out the hot ones.
+	 *
+	 * The tree is immutable, so the entries are never stale; use a new (or cleared) cache for a new tree.
+	 * All methods are safe to call concurrently.
+	 * The budget can be controlled by the MemoryGovernor.
+	 */
+	class ResultCache : public GovernedCache
+	{
+		public:
+		/**
+		 * @brief Construct a new Result Cache object
+		 *
+		 * @param budget the maximum total size of the cached results in bytes
+		 */
+		ResultCache(number budget);
+
+		/**
+		 * @brief looks up the result and records the access
+		 *
+		 * @param key the identity of the search
+		 * @param response the cached result is appended to it (if found)
+		 * @return true if the result was found
+		 * @return false otherwise
+		 */
+		bool lookup(const ResultKey &key, vector<bytes> &response);
+
+		/**
+		 * @brief offers the result to the cache, which may reject it (see admission policy)
+		 *
+		 * @param key the identity of the search
+		 * @param response the result of the search
+		 * @return true if the result was admitted
+		 * @return false otherwise
+		 */
+		bool insert(const ResultKey &key, const vector<bytes> &response);
+
+		/**
+		 * @brief removes all entries (the frequencies are kept)
+		 *
+		 */
+		void clear();
+
+		/**
+		 * @brief a getter for the total size of the cached results
+		 *
+		 * @return number the size in bytes
+		 */
+		number size() const;
+
+		/**
+		 * @brief a getter for the number of lookups that found the result
+		 *
+		 * @return number the number of hits
+		 */
+		number hits() const;
+
+		/**
+		 * @brief a getter for the number of lookups that did not find the result
+		 *
+		 * @return number the number of misses
+		 */
+		number misses() const;
+
+		/**
+		 * @brief same as size
+		 *
+		 * @return number the size in bytes
+		 */
+		number memoryUsage() const final;
+
+		/**
+		 * @brief gives the number of hits so far
+		 *
+		 * @return number the benefit
+		 */
+		number benefit() const final;
+
+		/**
+		 * @brief sets the budget, evicting the least recently used entries if needed
+		 *
+		 * @param budget the size in bytes
+		 */
+		void setBudget(number budget) final;
+
+		private:
+		/**
+		 * @brief a cached result and its position in the LRU list
+		 *
+		 */
+		struct Entry
+		{
+			vector<bytes> response;
+			number size;
+			list<ResultKey>::iterator position;
+		};
+
+		/**
+		 * @brief hashes the key (with a seed, for the rows of the sketch)
+		 *
+		 */
+		struct KeyHash
+		{
+			size_t operator()(const ResultKey &key) const;
+		};
+
+		static inline const number SKETCH_ROWS	= 4;
+		static inline const number SKETCH_WIDTH = 4096;
+		static inline const uchar SKETCH_MAX	= 15;
+		// the counters are halved after this many increments, so that the old popularity fades
+		static inline const number SKETCH_SAMPLE = 10 * SKETCH_WIDTH;
+
+		number budget;
+		number used = 0;
+
+		mutable mutex lock;
+		unordered_map<ResultKey, Entry, KeyHash> entries;
+		// the front is the most recent
+		list<ResultKey> recency;
+
+		vector<uchar> sketch;
+		number increments = 0;
+
+		number hitCount	 = 0;
+		number missCount = 0;
+
+		/**
+		 * @brief increments the estimated frequency of the key
+		 *
+		 * @param key the key accessed
+		 */
+		void record(const ResultKey &key);
+
+		/**
+		 * @brief gives the estimated frequency of the key
+		 *
+		 * @param key the key in question
+		 * @return number the minimum of the counters
+		 */
+		number frequency(const ResultKey &key) const;
+
+		/**
+		 * @brief gives the index of the key's counter in the row of the sketch
+		 *
+		 * @param key the key in question
+		 * @param row the row of the sketch
+		 * @return number the index in the sketch
+		 */
+		static number cell(const ResultKey &key, number row);
+	};
+}
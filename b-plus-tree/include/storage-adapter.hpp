@@ -1,9 +1,14 @@
 #pragma once
 
 #include "definitions.h"
+#include "memory-governor.hpp"
 
-#include <fstream>
-#include <map>
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 namespace BPlusTree
 {
@@ -12,6 +17,8 @@ namespace BPlusTree
 	/**
 	 * @brief Abstraction over secondary storage (modeled as RAM)
 	 *
+	 * Thread safety: the const methods (get, willNeed, etc.) must be safe to call concurrently from any number of threads,
+	 * as long as no thread modifies the storage (set, malloc) at the same time.
 	 */
 	class AbsStorageAdapter
 	{
@@ -22,7 +29,7 @@ namespace BPlusTree
 		 * @param location the address from which to read
 		 * @param response the bytes read, one block
 		 */
-		virtual void get(number location, bytes &response) = 0;
+		virtual void get(number location, bytes &response) const = 0;
 
 		/**
 		 * @brief write one block of bytes to the address
@@ -45,21 +52,81 @@ namespace BPlusTree
 		 *
 		 * @return number the "null" address, guaranteed to never be allocated
 		 */
-		virtual number empty() = 0;
+		virtual number empty() const = 0;
 
 		/**
 		 * @brief gives the address of the special (reserved) meta block
 		 *
 		 * @return number the address of the meta block
 		 */
-		virtual number meta() = 0;
+		virtual number meta() const = 0;
 
 		/**
 		 * @brief Returns the amount of malloc'ed space in bytes.
 		 *
 		 * @return number number of malloc'ed bytes.
 		 */
-		virtual number size() = 0;
+		virtual number size() const = 0;
+
+		/**
+		 * @brief gives the address of the block the given number of blocks past the address (in the address order)
+		 *
+		 * @param location the address to start from
+		 * @param count the number of blocks to skip
+		 * @return number the address of the block count blocks after location
+		 */
+		virtual number advance(number location, number count) const = 0;
+
+		/**
+		 * @brief hints that the blocks at the addresses will be read soon
+		 *
+		 * The adapter may start fetching them asynchronously, so that the subsequent get is cheaper.
+		 * It is only a hint, the default implementation does nothing.
+		 *
+		 * @param locations the addresses of the blocks to be read
+		 */
+		virtual void willNeed(const vector<number> &locations) const;
+
+		/**
+		 * @brief same as get, but hints that the block is unlikely to be read again soon
+		 *
+		 * Caching layers should not admit the block (e.g. when it is read by a wide range scan).
+		 * The default implementation is get.
+		 *
+		 * @param location the address from which to read
+		 * @param response the bytes read, one block
+		 */
+		virtual void getOnce(number location, bytes &response) const;
+
+		/**
+		 * @brief loads the blocks at the addresses ahead of time, because they are expected to be hot
+		 *
+		 * Caching layers should admit them as frequently used.
+		 * The default implementation is willNeed (e.g. warms the OS page cache).
+		 *
+		 * @param locations the addresses of the blocks to load
+		 */
+		virtual void warm(const vector<number> &locations) const;
+
+		/**
+		 * @brief hints that the blocks starting at the address will be read in the address order (e.g. a range scan)
+		 *
+		 * The adapter may read ahead the given number of blocks, but not past them.
+		 * A long scan repeats the hint as it moves along, so concurrent scans do not interfere.
+		 * It is only a hint, the default implementation does nothing.
+		 *
+		 * @param location the address of the first block to be read
+		 * @param count the number of blocks (in the address order) to read ahead
+		 */
+		virtual void adviseSequential(number location, number count) const;
+
+		/**
+		 * @brief hints that the blocks will be read in no particular order (e.g. point lookups)
+		 *
+		 * The adapter should not read ahead, it would only waste the I/O and the cache.
+		 * It is only a hint, the default implementation does nothing.
+		 */
+		virtual void adviseRandom() const;
 
 		/**
 		 * @brief Construct a new Abs Storage Adapter object
@@ -74,7 +141,7 @@ namespace BPlusTree
 		 *
 		 * @return number the size of block in bytes
 		 */
-		number getBlockSize();
+		number getBlockSize() const;
 
 		protected:
 		number blockSize;
@@ -83,31 +150,41 @@ namespace BPlusTree
 	/**
 	 * @brief In-memory implementation of the storage adapter.
 	 *
-	 * Uses a RAM array as the underlying storage.
+	 * Uses a RAM array as the underlying storage (indexed directly by the address).
 	 */
 	class InMemoryStorageAdapter : public AbsStorageAdapter
 	{
 		private:
-		map<number, bytes> memory;
+		vector<bytes> memory;
 		number locationCounter = META + 1;
 
 		static inline const number EMPTY = 0;
 		static inline const number META	 = 1;
 
-		void checkLocation(number location);
+		static inline const number CACHE_LINE = 64;
+
+		void checkLocation(number location) const;
 
 		public:
 		InMemoryStorageAdapter(number blockSize);
 		~InMemoryStorageAdapter() final;
 
-		void get(number location, bytes &response) final;
+		void get(number location, bytes &response) const final;
 		void set(number location, const bytes &data) final;
 		number malloc() final;
 
-		number empty() final;
-		number meta() final;
+		number empty() const final;
+		number meta() const final;
 
-		number size() final;
+		number size() const final;
+		number advance(number location, number count) const final;
+
+		/**
+		 * @brief issues CPU prefetches for the blocks, so that they are in cache when read
+		 *
+		 * @param locations the addresses of the blocks to be read
+		 */
+		void willNeed(const vector<number> &locations) const final;
 	};
 
 	/**
@@ -118,24 +195,231 @@ namespace BPlusTree
 	class FileSystemStorageAdapter : public AbsStorageAdapter
 	{
 		private:
-		fstream file;
+		int file;
 		number locationCounter;
 
 		static inline const number EMPTY = 0;
 
-		void checkLocation(number location);
+		void checkLocation(number location) const;
 
 		public:
 		FileSystemStorageAdapter(number blockSize, string filename, bool override);
 		~FileSystemStorageAdapter() final;
 
-		void get(number location, bytes &response) final;
+		void get(number location, bytes &response) const final;
+		void set(number location, const bytes &data) final;
+		number malloc() final;
+
+		number empty() const final;
+		number meta() const final;
+
+		number size() const final;
+		number advance(number location, number count) const final;
+
+		/**
+		 * @brief issues posix_fadvise(WILLNEED) for the blocks, so the kernel reads them in the background
+		 *
+		 * @param locations the addresses of the blocks to be read
+		 */
+		void willNeed(const vector<number> &locations) const final;
+
+		/**
+		 * @brief issues posix_fadvise(WILLNEED) for the blocks from the address on
+		 *
+		 * Only the given byte range is read ahead, the access pattern of the file is left alone
+		 * (Linux applies SEQUENTIAL to the whole file, so the concurrent queries would flip it).
+		 * The file is opened in the random mode (no kernel readahead), so the scans read ahead only through this,
+		 * the same before and after any point lookup (adviseRandom has nothing left to do).
+		 *
+		 * @param location the address of the first block to be read
+		 * @param count the number of blocks to read ahead
+		 */
+		void adviseSequential(number location, number count) const final;
+	};
+
+	/**
+	 * @brief Caching layer over another storage adapter.
+	 *
+	 * Keeps up to capacity blocks in memory using the scan-resistant 2Q policy:
+	 * a block read for the first time enters a small FIFO queue (A1in) and is evicted from there
+	 * unless it is read again after it left the queue (its address is remembered in A1out),
+	 * only then it is promoted to the main LRU queue (Am).
+	 * This way a wide scan that touches each block once cannot flush the hot blocks (e.g. the inner nodes).
+	 * Blocks read with getOnce are not admitted at all.
+	 *
+	 * Writes go through to the underlying storage.
+	 * All methods are safe to call concurrently.
+	 * The capacity can be controlled by the MemoryGovernor.
+	 */
+	class CachedStorageAdapter : public AbsStorageAdapter, public GovernedCache
+	{
+		private:
+		/**
+		 * @brief the queue of 2Q the cached block belongs to
+		 *
+		 */
+		enum Queue
+		{
+			A1in,
+			Am
+		};
+
+		/**
+		 * @brief a cached block and its position in the queue
+		 *
+		 */
+		struct Entry
+		{
+			bytes data;
+			Queue queue;
+			list<number>::iterator position;
+		};
+
+		shared_ptr<AbsStorageAdapter> storage;
+		// guarded by the lock, changes with setBudget
+		mutable number capacity;
+
+		mutable mutex lock;
+		mutable unordered_map<number, Entry> entries;
+		// the fronts are the most recent
+		mutable list<number> a1in;
+		mutable list<number> am;
+		mutable list<number> a1out;
+		mutable unordered_map<number, list<number>::iterator> ghosts;
+
+		mutable number hitCount	 = 0;
+		mutable number missCount = 0;
+
+		// the background recording of the warm set
+		thread recorder;
+		mutex recorderLock;
+		condition_variable recorderStop;
+		bool stopping = false;
+
+		/**
+		 * @brief gives the memory a cached block takes: the block itself, the entry, the map and list nodes
+		 *
+		 * @return number the size in bytes
+		 */
+		number entrySize() const;
+
+		/**
+		 * @brief reads the block through the cache, optionally admitting it on miss
+		 *
+		 * @param location the address from which to read
+		 * @param response the bytes read, one block
+		 * @param admit whether to admit the block on miss
+		 */
+		void get(number location, bytes &response, bool admit) const;
+
+		/**
+		 * @brief evicts the blocks until the cache fits the capacity
+		 *
+		 */
+		void reclaim() const;
+
+		public:
+		/**
+		 * @brief Construct a new Cached Storage Adapter object
+		 *
+		 * @param storage the underlying storage
+		 * @param capacity the maximum number of cached blocks
+		 */
+		CachedStorageAdapter(shared_ptr<AbsStorageAdapter> storage, number capacity);
+		~CachedStorageAdapter() final;
+
+		void get(number location, bytes &response) const final;
+		void getOnce(number location, bytes &response) const final;
 		void set(number location, const bytes &data) final;
 		number malloc() final;
 
-		number empty() final;
-		number meta() final;
+		number empty() const final;
+		number meta() const final;
+
+		number size() const final;
+		number advance(number location, number count) const final;
+
+		void willNeed(const vector<number> &locations) const final;
+		void adviseSequential(number location, number count) const final;
+		void adviseRandom() const final;
+
+		/**
+		 * @brief reads the missing blocks from the underlying storage and admits them directly to the main queue (Am)
+		 *
+		 * @param locations the addresses of the blocks to load
+		 */
+		void warm(const vector<number> &locations) const final;
+
+		/**
+		 * @brief gives the addresses of the cached blocks, the hottest first (Am in LRU order, then A1in)
+		 *
+		 * @return vector<number> the addresses of the cached blocks
+		 */
+		vector<number> hotSet() const;
+
+		/**
+		 * @brief writes the hot set to the file (atomically, via a temporary file)
+		 *
+		 * @param filename the file to write
+		 */
+		void saveWarmSet(string filename) const;
+
+		/**
+		 * @brief reads the hot set written by saveWarmSet
+		 *
+		 * @param filename the file to read
+		 * @return vector<number> the addresses, or empty if the file does not exist
+		 */
+		static vector<number> loadWarmSet(string filename);
 
-		number size() final;
+		/**
+		 * @brief starts saving the warm set to the file in the background, every period and on destruction
+		 *
+		 * @param filename the file to write
+		 * @param period the time between the saves
+		 */
+		void recordWarmSet(string filename, chrono::milliseconds period);
+
+		/**
+		 * @brief a getter for the number of reads served from the cache
+		 *
+		 * @return number the number of hits
+		 */
+		number hits() const;
+
+		/**
+		 * @brief a getter for the number of reads that went to the underlying storage
+		 *
+		 * @return number the number of misses
+		 */
+		number misses() const;
+
+		/**
+		 * @brief a getter for the number of cached blocks
+		 *
+		 * @return number the number of blocks in the cache
+		 */
+		number cached() const;
+
+		/**
+		 * @brief gives the memory held by the cached blocks (including the bookkeeping)
+		 *
+		 * @return number the size in bytes
+		 */
+		number memoryUsage() const final;
+
+		/**
+		 * @brief gives the number of hits so far
+		 *
+		 * @return number the benefit
+		 */
+		number benefit() const final;
+
+		/**
+		 * @brief sets the capacity to as many blocks as fit in the budget, evicting if needed
+		 *
+		 * @param budget the size in bytes
+		 */
+		void setBudget(number budget) final;
 	};
 }
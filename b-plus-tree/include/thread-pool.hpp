@@ -0,0 +1,85 @@
+#pragma once
+
+#include "definitions.h"
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+namespace BPlusTree
+{
+	using namespace std;
+
+	/**
+	 * @brief Fixed-size pool of worker threads with a bounded number of tasks in flight
+	 *
+	 */
+	class ThreadPool
+	{
+		public:
+		/**
+		 * @brief Construct a new Thread Pool object
+		 *
+		 * @param threads the number of worker threads (at least one)
+		 * @param capacity the maximum number of tasks in flight (queued plus running)
+		 */
+		ThreadPool(number threads, number capacity);
+
+		/**
+		 * @brief Destroy the Thread Pool object
+		 *
+		 * Runs the queued tasks to completion and joins the workers.
+		 * It may be called from a task (e.g. the task releases the last reference to the pool's owner),
+		 * then that worker is detached instead and exits on its own once the queue is drained.
+		 */
+		~ThreadPool();
+
+		/**
+		 * @brief schedules the task for execution on one of the workers
+		 *
+		 * Never blocks: if the pool is at capacity, the task is rejected.
+		 *
+		 * @param task the task to run
+		 * @return true if the task was accepted
+		 * @return false if there are already capacity tasks in flight
+		 */
+		bool submit(function<void()> task);
+
+		/**
+		 * @brief a getter for the number of tasks in flight
+		 *
+		 * @return number the number of queued and running tasks
+		 */
+		number inFlight();
+
+		private:
+		/**
+		 * @brief the state shared with the workers, so that a detached worker may outlive the pool object
+		 *
+		 */
+		struct State
+		{
+			queue<function<void()>> tasks;
+
+			mutex lock;
+			condition_variable available;
+
+			number capacity;
+			number active = 0;
+			bool stopping = false;
+		};
+
+		shared_ptr<State> state;
+		vector<thread> workers;
+
+		/**
+		 * @brief the loop of a worker thread: take a task, run it, repeat until stopped and drained
+		 *
+		 * @param state the state of the pool
+		 */
+		static void work(shared_ptr<State> state);
+	};
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "definitions.h"
+#include "tree.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace BPlusTree
+{
+	using namespace std;
+
+	/**
+	 * @brief A published, swappable reference to the current tree
+	 *
+	 * Readers acquire the current tree and keep using it for as long as they hold the reference,
+	 * even if a new tree is published in the meantime.
+	 * Publishing never waits for the readers: the old tree (and its storage) is reclaimed
+	 * when the last reader releases it.
+	 *
+	 * The current tree and its epoch are kept together in a version, protected by hazard pointers:
+	 * a reader announces the version it is about to copy the reference from in a slot of the handle,
+	 * and the publisher frees a replaced version only once no slot holds it.
+	 * So acquire takes no lock, it costs a few atomic operations on a slot and the increment of the tree's reference count.
+	 * A slot is held only while the reference is copied, so the publisher waits for a few instructions at most,
+	 * never for the readers using the tree.
+	 */
+	class TreeHandle
+	{
+		public:
+		/**
+		 * @brief Construct a new Tree Handle object
+		 *
+		 * @param tree the initial tree (may be nullptr)
+		 */
+		TreeHandle(shared_ptr<const Tree> tree = nullptr);
+
+		/**
+		 * @brief Destroy the Tree Handle object
+		 *
+		 * Must not run concurrently with the readers of the handle (they may keep the trees they have acquired).
+		 */
+		~TreeHandle();
+
+		/**
+		 * @brief returns the current tree
+		 *
+		 * Safe to call concurrently with other readers and with publish.
+		 *
+		 * @return shared_ptr<const Tree> the reference to the current tree (may be nullptr if nothing was published)
+		 */
+		shared_ptr<const Tree> acquire() const;
+
+		/**
+		 * @brief returns the current tree and its epoch, consistent with each other
+		 *
+		 * @param epoch the epoch of the returned tree (the number of publications before it)
+		 * @return shared_ptr<const Tree> the reference to the current tree (may be nullptr if nothing was published)
+		 */
+		shared_ptr<const Tree> acquire(number &epoch) const;
+
+		/**
+		 * @brief atomically replaces the current tree
+		 *
+		 * Publications are serialized among themselves, but never wait for the readers
+		 * (only for the ones copying the reference from the replaced version at that very moment).
+		 *
+		 * @param tree the new tree
+		 * @return shared_ptr<const Tree> the previous tree (released by the handle)
+		 */
+		shared_ptr<const Tree> publish(shared_ptr<const Tree> tree);
+
+		/**
+		 * @brief returns the number of publications so far
+		 *
+		 * Changes every time a new tree is published.
+		 * To tag data derived from a particular tree, get the epoch with the tree from acquire(epoch);
+		 * a separate call may see the next publication.
+		 *
+		 * @return number the epoch of the current tree
+		 */
+		number epoch() const;
+
+		private:
+		/**
+		 * @brief a published tree with its epoch, replaced as a whole
+		 *
+		 */
+		struct Version
+		{
+			shared_ptr<const Tree> tree;
+			number epoch;
+		};
+
+		/**
+		 * @brief a hazard pointer: the version a reader is copying from (nullptr if the slot is free)
+		 *
+		 * Each on its own cache line, so that the readers on different cores do not contend.
+		 */
+		struct alignas(64) Slot
+		{
+			atomic<Version *> version = nullptr;
+		};
+
+		// the number of readers that may be copying the reference at the same time (the others wait for a slot)
+		static inline const number SLOTS = 64;
+
+		atomic<Version *> current;
+		mutable Slot slots[SLOTS];
+
+		// serializes the publications (the readers never take it)
+		mutex publishLock;
+	};
+}
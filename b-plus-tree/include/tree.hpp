@@ -1,7 +1,17 @@
 #pragma once
 
 #include "definitions.h"
+#include "result-cache.hpp"
 #include "storage-adapter.hpp"
+#include "thread-pool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <unordered_map>
 
 namespace BPlusTree
 {
@@ -25,11 +35,234 @@ namespace BPlusTree
 		NodeBlock
 	};
 
+	/**
+	 * @brief Bounds the work of the searches it is passed to (see SearchOptions::control)
+	 *
+	 * A search checks it between the block reads and stops once it is cancelled or past the deadline,
+	 * returning what it has found so far and marking the control as truncated.
+	 * All methods are safe to call concurrently, one control may be shared by many searches.
+	 */
+	class QueryControl
+	{
+		public:
+		/**
+		 * @brief Construct a new Query Control object
+		 *
+		 * @param deadline the time after which the searches stop (none by default)
+		 */
+		QueryControl(chrono::steady_clock::time_point deadline = chrono::steady_clock::time_point::max());
+
+		/**
+		 * @brief stops the searches at their next check
+		 *
+		 */
+		void cancel();
+
+		/**
+		 * @brief tells if the searches should stop
+		 *
+		 * @return true if cancelled or past the deadline
+		 */
+		bool expired() const;
+
+		/**
+		 * @brief marks that a search has stopped early (called by the search)
+		 *
+		 */
+		void truncate();
+
+		/**
+		 * @brief tells if any of the searches has stopped early, so its results are partial
+		 *
+		 * @return true if truncated
+		 */
+		bool truncated() const;
+
+		private:
+		chrono::steady_clock::time_point deadline;
+		atomic<bool> cancelled	   = false;
+		atomic<bool> truncatedFlag = false;
+	};
+
+	/**
+	 * @brief A comparison of the payload bytes [offset, offset + value size) with the value (lexicographically, as memcmp)
+	 *
+	 * The bytes must be in the first storage block of the Data Block.
+	 * A payload too short to have the bytes does not match.
+	 */
+	struct PayloadCondition
+	{
+		enum Comparison
+		{
+			Equal,
+			NotEqual,
+			Less,
+			LessOrEqual,
+			Greater,
+			GreaterOrEqual
+		};
+
+		number offset;
+		bytes value;
+		Comparison comparison = Equal;
+	};
+
+	/**
+	 * @brief A condition on the record, evaluated on the bytes of the storage block in place (before any copy)
+	 *
+	 * @param key the key of the record
+	 * @param data the pointer to the payload bytes in the first storage block of the Data Block
+	 * @param size the number of the payload bytes in the first storage block (the whole payload if it fits)
+	 * @return true if the record should be returned
+	 */
+	using PayloadPredicate = function<bool(number key, const uchar *data, number size)>;
+
+	/**
+	 * @brief Optional parameters of the search
+	 *
+	 */
+	struct SearchOptions
+	{
+		/**
+		 * @brief the offset of the first payload byte to return
+		 *
+		 */
+		number offset = 0;
+
+		/**
+		 * @brief the maximum number of payload bytes to return (starting at offset)
+		 *
+		 * Continuation storage blocks past the window are not read.
+		 */
+		number length = ULLONG_MAX;
+
+		/**
+		 * @brief the maximum number of records to return from a range (per range or key in the multi-range and batch searches)
+		 *
+		 * The scan stops right after the last of them, so "the first N records from X" reads about N Data Blocks whatever the end is.
+		 */
+		number limit = ULLONG_MAX;
+
+		/**
+		 * @brief whether the data blocks read by the search may be admitted to the storage cache
+		 *
+		 * Unset it for wide scans, so that they do not evict the blocks the point lookups depend on
+		 * (see AbsStorageAdapter::getOnce). Node blocks are always cached.
+		 */
+		bool cache = true;
+
+		/**
+		 * @brief the deadline and cancellation of the search, none if null
+		 *
+		 * Checked between the block reads (the continuation blocks of a payload too); once it fires, the search returns the partial results
+		 * and marks the control as truncated. The last payload returned may then be cut short (a paged scan returns it again on the next page).
+		 */
+		shared_ptr<QueryControl> control;
+
+		/**
+		 * @brief the conditions the payload must satisfy (all of them), checked before the payload is read
+		 *
+		 * Only the first storage block of a Data Block is read for a record that does not match.
+		 * The projection (offset and length) applies to the matching records, the limit counts them only.
+		 */
+		vector<PayloadCondition> conditions;
+
+		/**
+		 * @brief the custom condition the payload must satisfy (if set), checked after the conditions
+		 *
+		 */
+		PayloadPredicate predicate;
+	};
+
+	/**
+	 * @brief The key distribution of the tree, computed at bulk load and persisted with the tree (see Tree::stats)
+	 *
+	 */
+	struct TreeStats
+	{
+		/**
+		 * @brief the number of records
+		 *
+		 */
+		number records = 0;
+
+		/**
+		 * @brief the number of distinct keys
+		 *
+		 */
+		number distinct = 0;
+
+		/**
+		 * @brief the smallest and the largest key
+		 *
+		 */
+		number minKey = 0;
+		number maxKey = 0;
+
+		/**
+		 * @brief the largest number of records with the same key
+		 *
+		 */
+		number maxDuplicates = 0;
+
+		/**
+		 * @brief the equi-depth histogram: pairs of (the largest key, the number of records) of each bucket, in the key order
+		 *
+		 * Bucket i holds the keys in (key of bucket i - 1, key of bucket i].
+		 * The records of a key are never split between the buckets, so a frequent key may make its bucket deeper.
+		 */
+		vector<pair<number, number>> histogram;
+
+		bool operator==(const TreeStats &other) const;
+	};
+
+	/**
+	 * @brief Consumer of the payload slices produced by the streaming search
+	 *
+	 * Invoked for every storage block of every payload in order, with the slice of this block's data.
+	 * The last slice of each payload has the flag set (it may be empty), so payloads can be delimited.
+	 *
+	 * @param key the key of the payload
+	 * @param data the pointer to the slice (valid only within the call)
+	 * @param size the size of the slice in bytes
+	 * @param last if this is the last slice of the payload
+	 */
+	using PayloadConsumer = function<void(number key, const uchar *data, number size, bool last)>;
+
+	/**
+	 * @brief Completion callback of the asynchronous search
+	 *
+	 * @param response the data found (empty if the search failed)
+	 * @param error the exception thrown by the search or nullptr if it succeeded
+	 */
+	using SearchCallback = function<void(vector<bytes> response, exception_ptr error)>;
+
+	/**
+	 * @brief Source of the probe keys of a join
+	 *
+	 * @param key the next probe key
+	 * @return true if the key was produced, false if the stream has ended
+	 */
+	using ProbeSource = function<bool(number &key)>;
+
+	/**
+	 * @brief Consumer of the matches of a join between two trees
+	 *
+	 * @param key the key of the record in this tree
+	 * @param payload the payload of the record in this tree
+	 * @param otherKey the key of the matching record in the other tree
+	 * @param otherPayload the payload of the matching record in the other tree
+	 */
+	using JoinConsumer = function<void(number key, const bytes &payload, number otherKey, const bytes &otherPayload)>;
+
 	/**
 	 * @brief The wrapper around the algorithms that traverse the tree
 	 *
+	 * Thread safety: the tree is immutable once constructed and all const methods (the searches) are safe
+	 * to call concurrently from any number of threads, for any storage adapter.
+	 * A single tree instance may serve all threads of a process.
 	 */
-	class Tree
+	class Tree : public enable_shared_from_this<Tree>
 	{
 		public:
 		/**
@@ -42,7 +275,7 @@ namespace BPlusTree
 		 * @param key a key to look for
 		 * @param response the data corresponding to the key
 		 */
-		void search(number key, vector<bytes> &response);
+		void search(number key, vector<bytes> &response) const;
 
 		/**
 		 * @brief same as search except it returns data corresponding to all key between given (inclusive)
@@ -51,7 +284,331 @@ namespace BPlusTree
 		 * @param end the inclusive upper range endpoint
 		 * @param response the data corresponding to the range
 		 */
-		void search(number start, number end, vector<bytes> &response);
+		void search(number start, number end, vector<bytes> &response) const;
+
+		/**
+		 * @brief same as search except it uses the given options (e.g. returns only a projection of each payload)
+		 *
+		 * @param key a key to look for
+		 * @param response the data corresponding to the key
+		 * @param options the search parameters
+		 */
+		void search(number key, vector<bytes> &response, const SearchOptions &options) const;
+
+		/**
+		 * @brief same as range search except it uses the given options (e.g. returns only a projection of each payload)
+		 *
+		 * @param start the inclusive lower range endpoint
+		 * @param end the inclusive upper range endpoint
+		 * @param response the data corresponding to the range
+		 * @param options the search parameters
+		 */
+		void search(number start, number end, vector<bytes> &response, const SearchOptions &options) const;
+
+		/**
+		 * @brief returns the data for each of the given keys
+		 *
+		 * The lookups are interleaved: up to BATCH_WIDTH traversals are in flight,
+		 * each advances by one block and prefetches the next one before yielding to the others.
+		 * This way the latency of a block read (a cache miss, or a disk read) of one lookup is hidden behind the work on the others.
+		 *
+		 * @param keys the keys to look for
+		 * @param response the data corresponding to each key (in the order of keys), same as in single-key search
+		 * @param options the search parameters
+		 */
+		void search(const vector<number> &keys, vector<vector<bytes>> &response, const SearchOptions &options = SearchOptions()) const;
+
+		/**
+		 * @brief returns the data for each of the given ranges in a single sweep
+		 *
+		 * The ranges are answered in the order of their starts.
+		 * The nodes on the path to the previous range are kept, so a descent starts from the lowest one that covers the next range.
+		 * If the scan of the previous range has stopped right before the next one, the next one continues along the chain without a descent.
+		 *
+		 * @param ranges the [start, end] ranges (inclusive), best sorted and disjoint, but need not be
+		 * @param response the data corresponding to each range (in the order of ranges), same as in range search
+		 * @param options the search parameters
+		 */
+		void search(const vector<pair<number, number>> &ranges, vector<vector<bytes>> &response, const SearchOptions &options = SearchOptions()) const;
+
+		/**
+		 * @brief joins the stream of probe keys with the tree (sort-merge), streaming out the matches
+		 *
+		 * Every probe key is matched with all the records of the key (a repeated probe key is matched again).
+		 * The tree is swept forward along with the stream, same as in the multi-range search:
+		 * the next probe continues from where the previous one stopped, and a descent is only needed when it is further ahead.
+		 * The keys should be sorted; an out-of-order key is still answered, but with a descent from the root.
+		 *
+		 * @param probes the source of the probe keys
+		 * @param consumer the callback receiving the payload slices of the matches in order (with their keys)
+		 * @param options the search parameters
+		 * @return number the number of matched records
+		 */
+		number join(const ProbeSource &probes, const PayloadConsumer &consumer, const SearchOptions &options = SearchOptions()) const;
+
+		/**
+		 * @brief same as join, but reads the probe keys (binary numbers, back to back) from the file descriptor until its end
+		 *
+		 * @param descriptor the descriptor to read the keys from (e.g. a file or a pipe)
+		 * @param consumer the callback receiving the payload slices of the matches in order (with their keys)
+		 * @param options the search parameters
+		 * @return number the number of matched records
+		 */
+		number join(int descriptor, const PayloadConsumer &consumer, const SearchOptions &options = SearchOptions()) const;
+
+		/**
+		 * @brief joins this tree with the other one, matching the records whose keys differ by at most distance
+		 *
+		 * The Data Block chains of both trees are merged in lockstep, so both are read sequentially.
+		 * Only the records of the other tree within the distance of the current key are kept in memory.
+		 * With threads > 1, the range is split (see splitKeys) and the partitions are joined in parallel;
+		 * the matches are still delivered in order (a partition is buffered until the preceding ones are delivered).
+		 * There is a single filter: the conditions and the predicate of the options must hold for the record of this tree
+		 * and for the record of the other tree alike (so both payloads need the bytes the conditions compare).
+		 *
+		 * @param other the tree to join with
+		 * @param start the inclusive lower endpoint of the keys of this tree
+		 * @param end the inclusive upper endpoint of the keys of this tree
+		 * @param distance the maximal difference of the matching keys (0 for the equi-join)
+		 * @param consumer the callback receiving the matching pairs, ordered by the key of this tree, then of the other tree
+		 * @param threads the number of partitions to join in parallel
+		 * @param options the search parameters (the same filter and projection for both trees)
+		 * @return number the number of matching pairs
+		 */
+		number join(const Tree &other, number start, number end, number distance, const JoinConsumer &consumer, number threads = 1, const SearchOptions &options = SearchOptions()) const;
+
+		/**
+		 * @brief returns the first page of the range scan and the continuation token for the next page
+		 *
+		 * The token is opaque (serializable bytes), it holds the position of the next record: its key and its Data Block address (and the MAC).
+		 * Pass it to resume to get the next page without a descent.
+		 *
+		 * @param start the inclusive lower range endpoint
+		 * @param end the inclusive upper range endpoint
+		 * @param count the maximal number of records in the page
+		 * @param response the data of the page
+		 * @param options the search parameters
+		 * @return bytes the continuation token, empty if there are no more records in the range
+		 */
+		bytes search(number start, number end, number count, vector<bytes> &response, const SearchOptions &options = SearchOptions()) const;
+
+		/**
+		 * @brief returns the next page of the range scan started by search (with a page size)
+		 *
+		 * The scan continues at the address in the token.
+		 * The token carries a MAC keyed with the secret of the storage, so a token that is altered or issued for another storage is rejected.
+		 * If the token does not point to the expected Data Block (e.g. the tree has been rebuilt in the same storage),
+		 * the scan descends to its key instead, skipping the records of that key the previous pages have returned.
+		 *
+		 * @param token the continuation token returned by the previous page
+		 * @param count the maximal number of records in the page
+		 * @param response the data of the page
+		 * @param options the search parameters
+		 * @return bytes the continuation token, empty if there are no more records in the range
+		 */
+		bytes resume(const bytes &token, number count, vector<bytes> &response, const SearchOptions &options = SearchOptions()) const;
+
+		/**
+		 * @brief streaming version of the range search
+		 *
+		 * Payloads are not materialized; instead, each storage block's slice is handed to the consumer as soon as it is read.
+		 *
+		 * @param start the inclusive lower range endpoint
+		 * @param end the inclusive upper range endpoint
+		 * @param consumer the callback receiving the payload slices in order
+		 * @param options the search parameters
+		 */
+		void search(number start, number end, const PayloadConsumer &consumer, const SearchOptions &options = SearchOptions()) const;
+
+		/**
+		 * @brief streaming version of the range search that writes the payloads (back to back) to the file descriptor
+		 *
+		 * Slices are written in batches with writev.
+		 *
+		 * @param start the inclusive lower range endpoint
+		 * @param end the inclusive upper range endpoint
+		 * @param descriptor the file descriptor to write to (e.g. a socket or a file)
+		 * @param options the search parameters
+		 * @return number the number of bytes written
+		 */
+		number search(number start, number end, int descriptor, const SearchOptions &options = SearchOptions()) const;
+
+		/**
+		 * @brief parallel version of the range search
+		 *
+		 * The range is split into sub-ranges at the separator keys of the inner node blocks,
+		 * the sub-ranges are scanned concurrently and the results are concatenated in order.
+		 *
+		 * @param start the inclusive lower range endpoint
+		 * @param end the inclusive upper range endpoint
+		 * @param response the data corresponding to the range (same as in the sequential search)
+		 * @param threads the maximum number of sub-ranges scanned concurrently
+		 * @param options the search parameters
+		 */
+		void searchParallel(number start, number end, vector<bytes> &response, number threads, const SearchOptions &options = SearchOptions()) const;
+
+		/**
+		 * @brief parallel version of the streaming range search
+		 *
+		 * The sub-ranges are scanned concurrently, and the consumer receives the slices in order (on the caller's thread):
+		 * the slices of a sub-range are buffered until all preceding sub-ranges are delivered.
+		 * A search with a limit is not split (it runs on the caller's thread), since its records are at the start of the range.
+		 *
+		 * @param start the inclusive lower range endpoint
+		 * @param end the inclusive upper range endpoint
+		 * @param consumer the callback receiving the payload slices in order
+		 * @param threads the maximum number of sub-ranges scanned concurrently
+		 * @param options the search parameters
+		 */
+		void searchParallel(number start, number end, const PayloadConsumer &consumer, number threads, const SearchOptions &options = SearchOptions()) const;
+
+		/**
+		 * @brief finds the keys that split the range into roughly equal sub-ranges
+		 *
+		 * Descends level by level, collecting the separator keys of the node blocks overlapping the range,
+		 * until there are enough of them (or the leaf level is reached).
+		 * Data blocks are never read.
+		 *
+		 * @param start the inclusive lower range endpoint
+		 * @param end the inclusive upper range endpoint
+		 * @param parts the desired number of sub-ranges
+		 * @return vector<number> up to parts - 1 ascending keys in [start, end), sub-range i ends at key i (inclusive)
+		 */
+		vector<number> splitKeys(number start, number end, number parts) const;
+
+		/**
+		 * @brief returns a uniform random sample (without replacement) of the records in the range
+		 *
+		 * The tree is packed (all node blocks but the rightmost on each level are full),
+		 * so the position (rank) of a record is known from the node blocks alone.
+		 * The ranks of the range endpoints are found with two descents, k ranks are drawn between them,
+		 * and only the Data Blocks at these ranks are read.
+		 * With the conditions or the predicate set, more ranks are drawn until k records match or the range is exhausted,
+		 * so the sample is uniform among the matching records.
+		 *
+		 * @param start the inclusive lower range endpoint
+		 * @param end the inclusive upper range endpoint
+		 * @param k the sample size, capped by the limit of the options
+		 * (all matching records of the range are returned if there are not more than k, fewer only if the search is stopped)
+		 * @param response the sampled data, in the key order
+		 * @param options the search parameters
+		 */
+		void sample(number start, number end, number k, vector<bytes> &response, const SearchOptions &options = SearchOptions()) const;
+
+		/**
+		 * @brief estimates the number of records in the range from the node blocks only (Data Blocks are never read)
+		 *
+		 * Same rank arithmetic as in sample.
+		 * With all levels read, the count is exact; with fewer (e.g. only the pinned ones), the position within the child of the deepest read level
+		 * is assumed to be in the middle, so the estimate is off by at most b^(height - levels) records.
+		 *
+		 * @param start the inclusive lower range endpoint
+		 * @param end the inclusive upper range endpoint
+		 * @param levels the number of node levels to read from the top
+		 * @return number the estimated number of records
+		 */
+		number estimateCount(number start, number end, number levels = ULLONG_MAX) const;
+
+		/**
+		 * @brief gives the key distribution computed at bulk load (kept in memory, no I/O)
+		 *
+		 * @return const TreeStats& the statistics (all zeros for a tree stored without them)
+		 */
+		const TreeStats &stats() const;
+
+		/**
+		 * @brief asynchronous version of the search
+		 *
+		 * The search runs on the tree's thread pool, so the caller (e.g. an event loop) is never blocked on storage I/O.
+		 * If the pool is at capacity, the operation is rejected and the future holds the exception.
+		 *
+		 * @param key a key to look for
+		 * @param options the search parameters
+		 * @return future<vector<bytes>> the data corresponding to the key
+		 */
+		future<vector<bytes>> searchAsync(number key, const SearchOptions &options = SearchOptions()) const;
+
+		/**
+		 * @brief asynchronous version of the range search (see searchAsync for a key)
+		 *
+		 * @param start the inclusive lower range endpoint
+		 * @param end the inclusive upper range endpoint
+		 * @param options the search parameters
+		 * @return future<vector<bytes>> the data corresponding to the range
+		 */
+		future<vector<bytes>> searchAsync(number start, number end, const SearchOptions &options = SearchOptions()) const;
+
+		/**
+		 * @brief asynchronous version of the range search that reports to the callback
+		 *
+		 * The callback is invoked on the pool's thread.
+		 * If the pool is at capacity, the callback is invoked immediately (on the caller's thread) with the exception.
+		 *
+		 * @param start the inclusive lower range endpoint
+		 * @param end the inclusive upper range endpoint
+		 * @param callback the completion callback
+		 * @param options the search parameters
+		 */
+		void searchAsync(number start, number end, const SearchCallback &callback, const SearchOptions &options = SearchOptions()) const;
+
+		/**
+		 * @brief sets the thread pool used by the asynchronous searches
+		 *
+		 * The pool may be shared by many trees.
+		 * If not set, the tree creates its own pool on first use (ASYNC_THREADS threads, ASYNC_CAPACITY operations in flight).
+		 *
+		 * @param pool the pool to use
+		 */
+		void setThreadPool(shared_ptr<ThreadPool> pool);
+
+		/**
+		 * @brief loads the top levels and the given blocks into the storage's cache, in the background
+		 *
+		 * Meant to be called right after opening the tree, with the warm set recorded before the restart
+		 * (see CachedStorageAdapter::recordWarmSet and CachedStorageAdapter::loadWarmSet).
+		 * The tree serves the searches while it warms up; the destructor waits for the warm-up to complete.
+		 *
+		 * @param levels the number of node levels to load, starting from the root
+		 * @param locations the addresses of the other blocks to load
+		 * @return future<void> completes when the warm-up is done (holds the exception if it failed)
+		 */
+		future<void> warmUp(number levels, const vector<number> &locations = {});
+
+		/**
+		 * @brief gives the memory held by the pinned levels (see pinLevels), e.g. to reserve it in the MemoryGovernor
+		 *
+		 * @return number the size in bytes (of all replicas)
+		 */
+		number pinnedSize() const;
+
+		/**
+		 * @brief sets the cache of the search results
+		 *
+		 * The searches that return the vector of payloads (point and range, also asynchronous) are answered
+		 * from the cache if possible, and offer their results to it otherwise.
+		 * The tree is immutable, so the cache needs no invalidation; a new tree should get a new cache.
+		 *
+		 * \note
+		 * Not safe to call concurrently with the searches; configure the tree before serving.
+		 *
+		 * @param cache the cache to use (nullptr to disable)
+		 */
+		void setResultCache(shared_ptr<ResultCache> cache);
+
+		/**
+		 * @brief keeps the top levels of the tree decoded in memory, so that the lookups do not read them from the storage
+		 *
+		 * With replication, each NUMA node gets its own copy (allocated by a thread bound to that node),
+		 * and the lookups use the copy local to the CPU they run on.
+		 * Data blocks are never pinned.
+		 *
+		 * \note
+		 * Not safe to call concurrently with the searches; configure the tree before serving.
+		 *
+		 * @param levels the number of node levels to pin, starting from the root (0 to unpin)
+		 * @param replicate if a copy should be kept per NUMA node
+		 */
+		void pinLevels(number levels, bool replicate = false);
 
 		/**
 		 * @brief Construct a new Tree object
@@ -76,13 +633,77 @@ namespace BPlusTree
 		 */
 		Tree(shared_ptr<AbsStorageAdapter> storage, vector<pair<number, bytes>> &data);
 
+		/**
+		 * @brief Destroy the Tree object
+		 *
+		 * Waits for the asynchronous searches of this tree to complete.
+		 * A tree owned by a shared_ptr is kept alive by its asynchronous searches instead, so it is never waited for
+		 * (the last search to complete destroys it, on the pool's thread).
+		 */
+		~Tree();
+
 		private:
 		shared_ptr<AbsStorageAdapter> storage;
 		number root;
+		// the number of node block levels (the leaf level is the last one)
+		number height;
 		number b;
+		// the number of records (Data Blocks)
+		number records;
+		TreeStats statistics;
+
+		// the number of buckets in the histogram of the statistics
+		static inline const number HISTOGRAM_BUCKETS = 64;
 
 		number leftmostDataBlock; // for testing
 
+		// the number of slices written by a single writev call
+		static inline const number WRITE_BATCH = 64;
+		// the number of interleaved lookups in a batch search
+		static inline const number BATCH_WIDTH = 16;
+		// the number of storage blocks a scan asks the storage to read ahead (renewed halfway through)
+		static inline const number READAHEAD = 64;
+
+		// the default thread pool parameters for the asynchronous searches
+		static inline const number ASYNC_THREADS  = 4;
+		static inline const number ASYNC_CAPACITY = 1024;
+
+		// the decoded node blocks of the pinned levels, one replica per NUMA node (or a single one)
+		vector<unordered_map<number, vector<pair<number, number>>>> pinned;
+		// the NUMA node (replica) of each CPU
+		vector<uint> cpuReplicas;
+
+		// marks the continuation tokens of the paged scans (and their format version)
+		static inline const number TOKEN_MAGIC = 0x746F6B656E000002;
+		// the key of the MAC of the continuation tokens, persisted in the meta block
+		pair<number, number> secret;
+
+		// the number of probe keys read by a single read call in the join
+		static inline const number PROBE_BATCH = 512;
+
+		/**
+		 * @brief the state of a forward sweep over the Data Blocks (see the multi-range search and the join)
+		 *
+		 */
+		struct Sweep
+		{
+			// the nodes from the root to the last visited leaf, the keys of each cover the previous start
+			vector<vector<pair<number, number>>> path;
+			// the first Data Block after the previous range (if any), and the end of that range
+			bytes held;
+			number heldAfter = 0;
+			number lastStart = 0;
+		};
+
+		shared_ptr<ResultCache> resultCache;
+
+		// created on the first asynchronous search (a const method, the readers get const trees), so mutable
+		mutable shared_ptr<ThreadPool> pool;
+		// guards the pool and the pending counter
+		mutable mutex asyncLock;
+		mutable condition_variable drained;
+		mutable number pending = 0;
+
 		/**
 		 * @brief Create a Data Block and store it in the storage
 		 *
@@ -103,17 +724,184 @@ namespace BPlusTree
 		 * @param data the data to be stored in the block
 		 * @param key the key corresponding to the data
 		 * @param next the pointer to the next data block for linked list (may be EMPTY)
+		 * @param addresses the addresses to use (see dataBlockSize), allocated here if empty
 		 * @return number the address of the newly created data block
 		 */
-		number createDataBlock(const bytes &data, number key, number next);
+		number createDataBlock(const bytes &data, number key, number next, vector<number> addresses = {});
+
+		/**
+		 * @brief gives the number of storage blocks a Data Block with the payload takes
+		 *
+		 * @param size the size of the payload in bytes
+		 * @return number the number of storage blocks
+		 */
+		number dataBlockSize(number size) const;
 
 		/**
 		 * @brief reads the data from the DataBlock
 		 *
+		 * Only the payload bytes in [offset, offset + length) are returned.
+		 * Storage blocks preceding the window are still read (they hold the pointers), but not copied;
+		 * storage blocks past the window are not read at all.
+		 *
 		 * @param block the first storage block of the Data Block (usually got with checkType)
+		 * @param offset the offset of the first payload byte to return
+		 * @param length the maximum number of payload bytes to return
 		 * @return tuple<bytes, number, number> tuple of data itself, associated key and address of the next Data Block
 		 */
-		tuple<bytes, number, number> readDataBlock(const bytes &block);
+		tuple<bytes, number, number> readDataBlock(const bytes &block, number offset = 0, number length = ULLONG_MAX) const;
+
+		/**
+		 * @brief streaming version of readDataBlock
+		 *
+		 * Hands the payload slices (restricted to the window) to the consumer block by block, without concatenating them.
+		 *
+		 * The control of the options is checked before each continuation block, so a long payload is cut short
+		 * (its last slice is handed over empty) once the control fires.
+		 *
+		 * @param block the first storage block of the Data Block (usually got with checkType)
+		 * @param options the payload window (offset and length), whether the continuation blocks may be cached and the control
+		 * @param consumer the callback receiving the slices
+		 * @return pair<number, number> the associated key and address of the next Data Block
+		 */
+		pair<number, number> readDataBlock(const bytes &block, const SearchOptions &options, const PayloadConsumer &consumer) const;
+
+		/**
+		 * @brief reads only the header of the DataBlock (without following the continuation blocks)
+		 *
+		 * @param block the first storage block of the Data Block (usually got with checkType)
+		 * @return pair<number, number> the associated key and address of the next Data Block
+		 */
+		pair<number, number> readDataBlockHeader(const bytes &block) const;
+
+		/**
+		 * @brief lets the storage read ahead the chain of a scan, READAHEAD storage blocks at a time
+		 *
+		 * Only a bounded window past the current block is advised, so concurrent queries do not fight over the file.
+		 * The window is renewed once the scan comes within READAHEAD / 2 storage blocks of its end,
+		 * so a Data Block of up to READAHEAD / 2 storage blocks is read inside the window whole.
+		 *
+		 * @param address the address of the current Data Block
+		 * @param advised the address past the window advised so far (0 before the first one, updated)
+		 */
+		void readAhead(number address, number &advised) const;
+
+		/**
+		 * @brief continues the sweep with the next range, handing its payloads to the consumer
+		 *
+		 * Starts from the held Data Block if it is the first of the range, otherwise descends from the lowest node on the path that covers the range.
+		 * A start lower than the previous one restarts the sweep from the root.
+		 *
+		 * @param state the state of the sweep (empty to start a new one)
+		 * @param start the inclusive lower range endpoint
+		 * @param end the inclusive upper range endpoint
+		 * @param consumer the callback receiving the payload slices in order
+		 * @param options the search parameters
+		 * @return number the number of records in the range
+		 */
+		number sweep(Sweep &state, number start, number end, const PayloadConsumer &consumer, const SearchOptions &options) const;
+
+		/**
+		 * @brief finds the first Data Block with the key not less than start
+		 *
+		 * @param start the key to look for
+		 * @return number the address of the Data Block, or EMPTY if all keys are smaller
+		 */
+		number findDataBlock(number start) const;
+
+		/**
+		 * @brief checks the control of the search (if any) and marks it truncated if it has fired
+		 *
+		 * @param options the search parameters
+		 * @return true if the search should stop
+		 */
+		bool stopped(const SearchOptions &options) const;
+
+		/**
+		 * @brief checks the conditions and the predicate of the search against the record (see SearchOptions)
+		 *
+		 * @param block the first storage block of the Data Block
+		 * @param options the search parameters
+		 * @return true if the record should be returned
+		 */
+		bool matches(const bytes &block, const SearchOptions &options) const;
+
+		/**
+		 * @brief reads a page of the range scan from the Data Block on (see search with a page size)
+		 *
+		 * @param address the address of the first Data Block of the page
+		 * @param end the inclusive upper range endpoint
+		 * @param count the maximal number of records in the page
+		 * @param key the key of the records counted in skip
+		 * @param skip the number of records of the key returned right before the address
+		 * @param response the data of the page
+		 * @param options the search parameters
+		 * @return bytes the continuation token, empty if there are no more records in the range
+		 */
+		bytes page(number address, number end, number count, number key, number skip, vector<bytes> &response, const SearchOptions &options) const;
+
+		/**
+		 * @brief computes the statistics of the sorted data
+		 *
+		 * @param data the data sorted by key
+		 * @return TreeStats the statistics
+		 */
+		static TreeStats computeStats(const vector<pair<number, bytes>> &data);
+
+		/**
+		 * @brief stores the statistics in a Data Block (not linked to the others)
+		 *
+		 * The blob is the numbers: records, distinct, minKey, maxKey, maxDuplicates, the number of buckets, and (key, count) for each bucket.
+		 *
+		 * @param stats the statistics to store
+		 * @return number the address of the Data Block
+		 */
+		number writeStats(const TreeStats &stats);
+
+		/**
+		 * @brief reads the statistics written by writeStats
+		 *
+		 * @param address the address of the Data Block
+		 * @return TreeStats the statistics
+		 */
+		TreeStats readStats(number address) const;
+
+		/**
+		 * @brief gives the number of records with the key less than the given one, using the node blocks only
+		 *
+		 * @param key the key to compare to
+		 * @param levels the number of node levels to read, if less than height the rank is estimated (see estimateCount)
+		 * @return number the rank of the first record with the key not less than the given one
+		 */
+		number rank(number key, number levels = ULLONG_MAX) const;
+
+		/**
+		 * @brief finds the Data Block at the rank (position in the key order), using the node blocks only
+		 *
+		 * @param rank the position, less than the number of records
+		 * @return number the address of the Data Block
+		 */
+		number recordAt(number rank) const;
+
+		/**
+		 * @brief gives the number of records under a child of a root
+		 *
+		 * @return number b to the power of (height - 1)
+		 */
+		number rootSpan() const;
+
+		/**
+		 * @brief the sequential part of the join between two trees (see join)
+		 *
+		 * @param other the tree to join with
+		 * @param start the inclusive lower endpoint of the keys of this tree
+		 * @param end the inclusive upper endpoint of the keys of this tree
+		 * @param distance the maximal difference of the matching keys
+		 * @param consumer the callback receiving the matching pairs
+		 * @param options the search parameters
+		 * @return number the number of matching pairs
+		 */
+		number joinRange(const Tree &other, number start, number end, number distance, const JoinConsumer &consumer, const SearchOptions &options) const;
 
 		/**
 		 * @brief Create a Node Block and store it in the storage
@@ -141,15 +929,41 @@ namespace BPlusTree
 		 * @param block block the first storage block of the Node Block (usually got with checkType)
 		 * @return vector<pair<number, number>> the pairs (in-order) of keys to addresses
 		 */
-		vector<pair<number, number>> readNodeBlock(const bytes &block);
+		vector<pair<number, number>> readNodeBlock(const bytes &block) const;
+
+		/**
+		 * @brief returns the pinned node block at the address from the replica local to the current CPU
+		 *
+		 * @param address the address of the node block
+		 * @return const vector<pair<number, number>>* the decoded node block, or nullptr if it is not pinned
+		 */
+		const vector<pair<number, number>> *pinnedNode(number address) const;
+
+		/**
+		 * @brief reads the node block at the address (from the pinned levels if possible)
+		 *
+		 * @param address the address of the node block
+		 * @return vector<pair<number, number>> the pairs (in-order) of keys to addresses
+		 */
+		vector<pair<number, number>> readNode(number address) const;
+
+		/**
+		 * @brief finds the child of the node block that holds the given key
+		 *
+		 * @param block the node block read with readNodeBlock
+		 * @param key the key to look for
+		 * @return number the address of the first child whose key is not smaller than the given, or EMPTY if there is none
+		 */
+		number findChild(const vector<pair<number, number>> &block, number key) const;
 
 		/**
 		 * @brief returns the type and the content of the block by the address
 		 *
 		 * @param address the address from which to read a block
+		 * @param once whether the block should be read with AbsStorageAdapter::getOnce
 		 * @return pair<BlockType, bytes> the type and the bytes of the block itself (to avoid double reading)
 		 */
-		pair<BlockType, bytes> checkType(number address);
+		pair<BlockType, bytes> checkType(number address, bool once = false) const;
 
 		/**
 		 * @brief creates a layer of node blocks (od a single level) and returns the indices of the next layer
@@ -177,13 +991,13 @@ namespace BPlusTree
 		 * @param largestKey the largest possible key
 		 * @param rightmost if this node (by address) is the rightmost (true for the root)
 		 */
-		void checkConsistency(number address, number largestKey, bool rightmost);
+		void checkConsistency(number address, number largestKey, bool rightmost) const;
 
 		/**
 		 * @brief runs checkConsistency with proper parameters (from root)
 		 *
 		 */
-		void checkConsistency();
+		void checkConsistency() const;
 
 		friend class TreeTest_ReadDataLayer_Test;
 		friend class TreeTest_CreateNodeBlockTooBig_Test;
@@ -196,6 +1010,10 @@ namespace BPlusTree
 		friend class TreeTest_ConsistencyCheckDataBlockKey_Test;
 		friend class TreeTest_ReadWrongNodeBlock_Test;
 		friend class TreeTest_ReadWrongDataBlock_Test;
+		friend class TreeTest_ReadDataBlockProjection_Test;
+		friend class TreeTest_PinLevels_Test;
+		friend class TreeTest_DataLayerForward_Test;
+		friend class TreeTest_Rank_Test;
 		friend class TreeTestBig_Simulation_Test;
 	};
 }
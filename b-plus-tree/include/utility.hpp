@@ -61,6 +61,15 @@ namespace BPlusTree
 	 */
 	vector<number> deconstructNumbers(bytes data);
 
+	/**
+	 * @brief computes the keyed hash (SipHash-2-4) of the numbers, a MAC that cannot be forged without the key
+	 *
+	 * @param key the 128-bit secret key
+	 * @param data the numbers to authenticate (hashed as their little-endian bytes)
+	 * @return number the 64-bit tag
+	 */
+	number sipHash(pair<number, number> key, const vector<number> &data);
+
 	/**
 	 * @brief converts a number to bytes
 	 *
@@ -76,4 +85,12 @@ namespace BPlusTree
 	 * @return number the resulting number
 	 */
 	number numberFromBytes(bytes data);
+
+	/**
+	 * @brief reads the NUMA topology of the machine (from sysfs)
+	 *
+	 * @return vector<vector<uint>> for each NUMA node, the CPUs it contains
+	 * (a single node with all CPUs if the machine is not NUMA or the topology is not available)
+	 */
+	vector<vector<uint>> numaTopology();
 }
@@ -0,0 +1,140 @@
+#include "memory-governor.hpp"
+
+#include <algorithm>
+
+namespace BPlusTree
+{
+	using namespace std;
+
+	GovernedCache::~GovernedCache()
+	{
+	}
+
+	MemoryGovernor::MemoryGovernor(number budget) :
+		budget(budget)
+	{
+	}
+
+	MemoryGovernor::~MemoryGovernor()
+	{
+		{
+			lock_guard<mutex> guard(lock);
+			stopping = true;
+		}
+		rebalancerStop.notify_all();
+		if (rebalancer.joinable())
+		{
+			rebalancer.join();
+		}
+	}
+
+	void MemoryGovernor::attach(shared_ptr<GovernedCache> cache)
+	{
+		lock_guard<mutex> guard(lock);
+		caches.push_back({cache, cache->benefit(), 0.0});
+		rebalanceLocked();
+	}
+
+	void MemoryGovernor::reserve(number bytes)
+	{
+		lock_guard<mutex> guard(lock);
+		reserved += bytes;
+		rebalanceLocked();
+	}
+
+	void MemoryGovernor::release(number bytes)
+	{
+		lock_guard<mutex> guard(lock);
+		reserved -= min(bytes, reserved);
+		rebalanceLocked();
+	}
+
+	void MemoryGovernor::rebalance()
+	{
+		lock_guard<mutex> guard(lock);
+		rebalanceLocked();
+	}
+
+	void MemoryGovernor::rebalanceLocked()
+	{
+		// forget the destroyed caches
+		caches.erase(
+			remove_if(caches.begin(), caches.end(), [](const Governed &governed) { return governed.cache.expired(); }),
+			caches.end());
+
+		vector<shared_ptr<GovernedCache>> alive;
+		for (auto &governed : caches)
+		{
+			alive.push_back(governed.cache.lock());
+		}
+		if (alive.empty())
+		{
+			return;
+		}
+
+		// smooth the benefit, so that a quiet period does not wipe a cache out
+		double total = 0;
+		for (uint i = 0; i < caches.size(); i++)
+		{
+			auto benefit = alive[i] ? alive[i]->benefit() : caches[i].lastBenefit;
+
+			caches[i].recentBenefit = (caches[i].recentBenefit + (benefit - caches[i].lastBenefit)) / 2;
+			caches[i].lastBenefit	= benefit;
+			total += caches[i].recentBenefit;
+		}
+
+		auto available = budget - min(reserved, budget);
+		auto equal	   = total == 0 ? available : (number)(available * MIN_SHARE);
+		auto shared	   = available - equal;
+
+		vector<number> budgets;
+		for (auto &governed : caches)
+		{
+			budgets.push_back(equal / caches.size() + (total == 0 ? 0 : (number)(shared * (governed.recentBenefit / total))));
+		}
+
+		// shrink first, so that the total does not exceed the budget in between
+		for (auto shrinking : {true, false})
+		{
+			for (uint i = 0; i < caches.size(); i++)
+			{
+				if (alive[i] && (alive[i]->memoryUsage() > budgets[i]) == shrinking)
+				{
+					alive[i]->setBudget(budgets[i]);
+				}
+			}
+		}
+	}
+
+	void MemoryGovernor::start(chrono::milliseconds period)
+	{
+		if (rebalancer.joinable())
+		{
+			throw Exception("the governor is already rebalancing");
+		}
+
+		rebalancer = thread([this, period]() {
+			unique_lock<mutex> guard(lock);
+			while (!rebalancerStop.wait_for(guard, period, [this] { return stopping; }))
+			{
+				rebalanceLocked();
+			}
+		});
+	}
+
+	number MemoryGovernor::usage() const
+	{
+		lock_guard<mutex> guard(lock);
+
+		auto result = reserved;
+		for (auto &governed : caches)
+		{
+			if (auto cache = governed.cache.lock())
+			{
+				result += cache->memoryUsage();
+			}
+		}
+
+		return result;
+	}
+}
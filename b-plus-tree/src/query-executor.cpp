@@ -0,0 +1,174 @@
+#include "query-executor.hpp"
+
+#include <atomic>
+
+namespace BPlusTree
+{
+	using namespace std;
+
+	QueryExecutor::QueryExecutor(number threads) :
+		threads(threads),
+		// the loops of the previous batch may still count as in flight for a moment after they are done
+		pool(max(threads, (number)1), 2 * max(threads, (number)1))
+	{
+		if (threads == 0)
+		{
+			throw Exception("query executor needs at least one thread");
+		}
+	}
+
+	vector<QueryResult> QueryExecutor::run(const Tree &tree, const vector<Query> &queries, const SearchOptions &options)
+	{
+		lock_guard<mutex> guard(runLock);
+		auto submitted = chrono::steady_clock::now();
+
+		vector<QueryResult> results(queries.size());
+		// the responses of each chunk of each query, concatenated once all are done
+		vector<vector<vector<bytes>>> chunks(queries.size());
+		vector<atomic<number>> remaining(queries.size());
+
+		// the point lookups go to a shared queue that the workers check first,
+		// the range queries are split into chunks dealt to the workers round-robin
+		WorkerQueue points;
+		vector<WorkerQueue> queues(threads);
+		number dealt = 0;
+		for (number i = 0; i < queries.size(); i++)
+		{
+			auto [start, end] = queries[i];
+			if (start >= end)
+			{
+				chunks[i].resize(1);
+				remaining[i] = 1;
+				points.tasks.push_back({i, 0, start, end});
+				continue;
+			}
+
+			// a limited query is not split, the first records are all in the first chunk
+			auto keys = options.limit == ULLONG_MAX ? tree.splitKeys(start, end, threads) : vector<number>();
+			chunks[i].resize(keys.size() + 1);
+			remaining[i] = keys.size() + 1;
+
+			for (number j = 0; j <= keys.size(); j++)
+			{
+				auto from = j == 0 ? start : keys[j - 1] + 1;
+				auto to	  = j == keys.size() ? end : keys[j];
+				queues[dealt++ % threads].tasks.push_back({i, j, from, to});
+			}
+		}
+
+		exception_ptr error;
+		mutex errorLock;
+
+		mutex doneLock;
+		condition_variable done;
+		number running = threads;
+
+		auto work = [&](number worker) {
+			Task task;
+			while (take(points, queues, worker, task))
+			{
+				auto &response = chunks[task.query][task.chunk];
+				try
+				{
+					if (task.start >= task.end || options.limit != ULLONG_MAX)
+					{
+						tree.search(task.start, task.end, response, options);
+					}
+					else
+					{
+						// a chunk is scanned a page at a time, the rest is queued again behind the other tasks
+						task.token = task.token.empty() ? tree.search(task.start, task.end, SCAN_PAGE, response, options) : tree.resume(task.token, SCAN_PAGE, response, options);
+						if (!task.token.empty() && !(options.control && options.control->expired()))
+						{
+							lock_guard<mutex> guard(queues[worker].lock);
+							queues[worker].tasks.push_back(move(task));
+							continue;
+						}
+					}
+				}
+				catch (...)
+				{
+					lock_guard<mutex> guard(errorLock);
+					error = current_exception();
+				}
+
+				if (--remaining[task.query] == 0)
+				{
+					results[task.query].latency = chrono::steady_clock::now() - submitted;
+				}
+			}
+
+			lock_guard<mutex> guard(doneLock);
+			if (--running == 0)
+			{
+				done.notify_one();
+			}
+		};
+
+		for (number worker = 0; worker < threads; worker++)
+		{
+			// the pool has room for two batches, so this only falls back to the caller if the pool is stuck
+			if (!pool.submit([&work, worker]() { work(worker); }))
+			{
+				work(worker);
+			}
+		}
+
+		unique_lock<mutex> doneGuard(doneLock);
+		done.wait(doneGuard, [&running] { return running == 0; });
+		doneGuard.unlock();
+
+		if (error)
+		{
+			rethrow_exception(error);
+		}
+
+		for (number i = 0; i < queries.size(); i++)
+		{
+			for (auto &chunk : chunks[i])
+			{
+				move(chunk.begin(), chunk.end(), back_inserter(results[i].response));
+			}
+		}
+
+		return results;
+	}
+
+	bool QueryExecutor::take(WorkerQueue &points, vector<WorkerQueue> &queues, number worker, Task &task)
+	{
+		{
+			lock_guard<mutex> guard(points.lock);
+			if (!points.tasks.empty())
+			{
+				task = points.tasks.front();
+				points.tasks.pop_front();
+				return true;
+			}
+		}
+
+		for (number i = 0; i < queues.size(); i++)
+		{
+			auto &queue = queues[(worker + i) % queues.size()];
+
+			lock_guard<mutex> guard(queue.lock);
+			if (queue.tasks.empty())
+			{
+				continue;
+			}
+
+			if (i == 0)
+			{
+				task = move(queue.tasks.front());
+				queue.tasks.pop_front();
+			}
+			else
+			{
+				task = move(queue.tasks.back());
+				queue.tasks.pop_back();
+			}
+			return true;
+		}
+
+		return false;
+	}
+}
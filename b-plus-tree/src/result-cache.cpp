@@ -0,0 +1,180 @@
+#include "result-cache.hpp"
+
+namespace BPlusTree
+{
+	using namespace std;
+
+	/**
+	 * @brief the finalizer of splitmix64, mixes the bits of the input
+	 *
+	 * @param x the input
+	 * @return number the mixed bits
+	 */
+	number mix(number x);
+
+	ResultCache::ResultCache(number budget) :
+		budget(budget),
+		sketch(SKETCH_ROWS * SKETCH_WIDTH, 0)
+	{
+	}
+
+	bool ResultCache::lookup(const ResultKey &key, vector<bytes> &response)
+	{
+		lock_guard<mutex> guard(lock);
+		record(key);
+
+		auto entry = entries.find(key);
+		if (entry == entries.end())
+		{
+			missCount++;
+			return false;
+		}
+
+		hitCount++;
+		recency.splice(recency.begin(), recency, entry->second.position);
+		response.insert(response.end(), entry->second.response.begin(), entry->second.response.end());
+
+		return true;
+	}
+
+	bool ResultCache::insert(const ResultKey &key, const vector<bytes> &response)
+	{
+		// account for the containers, not only for the payloads
+		number size = sizeof(Entry) + sizeof(ResultKey) + response.size() * sizeof(bytes);
+		for (auto &payload : response)
+		{
+			size += payload.size();
+		}
+
+		lock_guard<mutex> guard(lock);
+		if (size > budget || entries.find(key) != entries.end())
+		{
+			return false;
+		}
+
+		// the candidate must be more popular than every victim
+		auto candidate = frequency(key);
+		number freed   = 0;
+		auto victim	   = recency.rbegin();
+		while (used - freed + size > budget)
+		{
+			if (frequency(*victim) >= candidate)
+			{
+				return false;
+			}
+			freed += entries[*victim].size;
+			victim++;
+		}
+
+		while (used + size > budget)
+		{
+			used -= entries[recency.back()].size;
+			entries.erase(recency.back());
+			recency.pop_back();
+		}
+
+		recency.push_front(key);
+		entries[key] = {response, size, recency.begin()};
+		used += size;
+
+		return true;
+	}
+
+	void ResultCache::clear()
+	{
+		lock_guard<mutex> guard(lock);
+		entries.clear();
+		recency.clear();
+		used = 0;
+	}
+
+	number ResultCache::size() const
+	{
+		lock_guard<mutex> guard(lock);
+		return used;
+	}
+
+	number ResultCache::hits() const
+	{
+		lock_guard<mutex> guard(lock);
+		return hitCount;
+	}
+
+	number ResultCache::misses() const
+	{
+		lock_guard<mutex> guard(lock);
+		return missCount;
+	}
+
+	number ResultCache::memoryUsage() const
+	{
+		return size();
+	}
+
+	number ResultCache::benefit() const
+	{
+		return hits();
+	}
+
+	void ResultCache::setBudget(number budget)
+	{
+		lock_guard<mutex> guard(lock);
+		this->budget = budget;
+		while (used > budget)
+		{
+			used -= entries[recency.back()].size;
+			entries.erase(recency.back());
+			recency.pop_back();
+		}
+	}
+
+	void ResultCache::record(const ResultKey &key)
+	{
+		for (number row = 0; row < SKETCH_ROWS; row++)
+		{
+			auto &counter = sketch[cell(key, row)];
+			if (counter < SKETCH_MAX)
+			{
+				counter++;
+			}
+		}
+
+		if (++increments == SKETCH_SAMPLE)
+		{
+			for (auto &counter : sketch)
+			{
+				counter /= 2;
+			}
+			increments = 0;
+		}
+	}
+
+	number ResultCache::frequency(const ResultKey &key) const
+	{
+		number result = SKETCH_MAX;
+		for (number row = 0; row < SKETCH_ROWS; row++)
+		{
+			result = min(result, (number)sketch[cell(key, row)]);
+		}
+
+		return result;
+	}
+
+	number ResultCache::cell(const ResultKey &key, number row)
+	{
+		return row * SKETCH_WIDTH + mix(KeyHash()(key) + row) % SKETCH_WIDTH;
+	}
+
+	size_t ResultCache::KeyHash::operator()(const ResultKey &key) const
+	{
+		auto [start, end, offset, length, limit] = key;
+		return mix(mix(mix(mix(mix(start) ^ end) ^ offset) ^ length) ^ limit);
+	}
+
+	number mix(number x)
+	{
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9uLL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebuLL;
+		return x ^ (x >> 31);
+	}
+}
@@ -4,6 +4,9 @@
 
 #include <boost/format.hpp>
 #include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <unistd.h>
 
 namespace BPlusTree
 {
@@ -21,11 +24,33 @@ namespace BPlusTree
 	{
 	}
 
-	number AbsStorageAdapter::getBlockSize()
+	number AbsStorageAdapter::getBlockSize() const
 	{
 		return blockSize;
 	}
 
+	void AbsStorageAdapter::willNeed(const vector<number> &locations) const
+	{
+	}
+
+	void AbsStorageAdapter::adviseSequential(number location, number count) const
+	{
+	}
+
+	void AbsStorageAdapter::adviseRandom() const
+	{
+	}
+
+	void AbsStorageAdapter::getOnce(number location, bytes &response) const
+	{
+		get(location, response);
+	}
+
+	void AbsStorageAdapter::warm(const vector<number> &locations) const
+	{
+		willNeed(locations);
+	}
+
 #pragma endregion AbsStorageAdapter
 
 #pragma region InMemoryStorageAdapter
@@ -33,6 +58,8 @@ namespace BPlusTree
 	InMemoryStorageAdapter::InMemoryStorageAdapter(number blockSize) :
 		AbsStorageAdapter(blockSize)
 	{
+		memory.resize(locationCounter);
+
 		auto emptyBlock = bytesFromNumber(empty());
 		emptyBlock.resize(blockSize);
 		set(meta(), emptyBlock);
@@ -42,7 +69,7 @@ namespace BPlusTree
 	{
 	}
 
-	void InMemoryStorageAdapter::get(number location, bytes &response)
+	void InMemoryStorageAdapter::get(number location, bytes &response) const
 	{
 		checkLocation(location);
 
@@ -63,25 +90,46 @@ namespace BPlusTree
 
 	number InMemoryStorageAdapter::malloc()
 	{
+		memory.resize(locationCounter + 1);
 		return locationCounter++;
 	}
 
-	number InMemoryStorageAdapter::empty()
+	void InMemoryStorageAdapter::willNeed(const vector<number> &locations) const
+	{
+		for (auto location : locations)
+		{
+			if (location != empty() && location < locationCounter)
+			{
+				auto block = memory[location].data();
+				for (number offset = 0; block != nullptr && offset < blockSize; offset += CACHE_LINE)
+				{
+					__builtin_prefetch(block + offset);
+				}
+			}
+		}
+	}
+
+	number InMemoryStorageAdapter::empty() const
 	{
 		return EMPTY;
 	}
 
-	number InMemoryStorageAdapter::meta()
+	number InMemoryStorageAdapter::meta() const
 	{
 		return META;
 	}
 
-	number InMemoryStorageAdapter::size()
+	number InMemoryStorageAdapter::size() const
 	{
 		return (locationCounter - 1) * blockSize;
 	}
 
-	void InMemoryStorageAdapter::checkLocation(number location)
+	number InMemoryStorageAdapter::advance(number location, number count) const
+	{
+		return location + count;
+	}
+
+	void InMemoryStorageAdapter::checkLocation(number location) const
 	{
 		if (location >= locationCounter)
 		{
@@ -96,19 +144,23 @@ namespace BPlusTree
 	FileSystemStorageAdapter::FileSystemStorageAdapter(number blockSize, string filename, bool override) :
 		AbsStorageAdapter(blockSize)
 	{
-		auto flags = fstream::in | fstream::out | fstream::binary | fstream::ate;
+		auto flags = O_RDWR;
 		if (override)
 		{
-			flags |= fstream::trunc;
+			flags |= O_CREAT | O_TRUNC;
 		}
 
-		file.open(filename, flags);
-		if (!file)
+		file = open(filename.c_str(), flags, 0644);
+		if (file < 0)
 		{
 			throw Exception(boost::format("cannot open %1%: %2%") % filename % strerror(errno));
 		}
 
-		locationCounter = override ? (2 * blockSize) : (number)file.tellg();
+		locationCounter = override ? (2 * blockSize) : (number)lseek(file, 0, SEEK_END);
+
+		// the point lookups would only pollute the page cache with the kernel readahead,
+		// the scans advise their own windows (see adviseSequential)
+		posix_fadvise(file, 0, 0, POSIX_FADV_RANDOM);
 
 		if (override)
 		{
@@ -120,16 +172,34 @@ namespace BPlusTree
 
 	FileSystemStorageAdapter::~FileSystemStorageAdapter()
 	{
-		file.close();
+		close(file);
 	}
 
-	void FileSystemStorageAdapter::get(number location, bytes &response)
+	void FileSystemStorageAdapter::get(number location, bytes &response) const
 	{
 		checkLocation(location);
 
 		uchar placeholder[blockSize];
-		file.seekg(location, file.beg);
-		file.read((char *)placeholder, blockSize);
+		number done = 0;
+		while (done < blockSize)
+		{
+			auto result = pread(file, placeholder + done, blockSize - done, location + done);
+			if (result < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (result < 0)
+			{
+				throw Exception(boost::format("cannot read block %1%: %2%") % location % strerror(errno));
+			}
+			if (result == 0)
+			{
+				// allocated, but never written past the end of file
+				memset(placeholder + done, 0, blockSize - done);
+				break;
+			}
+			done += result;
+		}
 
 		response.insert(response.begin(), placeholder, placeholder + blockSize);
 	}
@@ -143,11 +213,39 @@ namespace BPlusTree
 
 		checkLocation(location);
 
-		uchar placeholder[blockSize];
-		copy(data.begin(), data.end(), placeholder);
+		number done = 0;
+		while (done < blockSize)
+		{
+			auto result = pwrite(file, data.data() + done, blockSize - done, location + done);
+			if (result < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (result < 0)
+			{
+				throw Exception(boost::format("cannot write block %1%: %2%") % location % strerror(errno));
+			}
+			done += result;
+		}
+	}
+
+	void FileSystemStorageAdapter::willNeed(const vector<number> &locations) const
+	{
+		for (auto location : locations)
+		{
+			if (location != empty())
+			{
+				posix_fadvise(file, location, blockSize, POSIX_FADV_WILLNEED);
+			}
+		}
+	}
 
-		file.seekp(location, file.beg);
-		file.write((const char *)placeholder, blockSize);
+	void FileSystemStorageAdapter::adviseSequential(number location, number count) const
+	{
+		if (location != empty() && count > 0)
+		{
+			posix_fadvise(file, location, count * blockSize, POSIX_FADV_WILLNEED);
+		}
 	}
 
 	number FileSystemStorageAdapter::malloc()
@@ -155,22 +253,27 @@ namespace BPlusTree
 		return locationCounter += blockSize;
 	}
 
-	number FileSystemStorageAdapter::empty()
+	number FileSystemStorageAdapter::empty() const
 	{
 		return EMPTY;
 	}
 
-	number FileSystemStorageAdapter::meta()
+	number FileSystemStorageAdapter::meta() const
 	{
 		return blockSize;
 	}
 
-	number FileSystemStorageAdapter::size()
+	number FileSystemStorageAdapter::size() const
 	{
 		return locationCounter - blockSize;
 	}
 
-	void FileSystemStorageAdapter::checkLocation(number location)
+	number FileSystemStorageAdapter::advance(number location, number count) const
+	{
+		return location + count * blockSize;
+	}
+
+	void FileSystemStorageAdapter::checkLocation(number location) const
 	{
 		if (location > locationCounter || location % blockSize != 0)
 		{
@@ -180,4 +283,327 @@ namespace BPlusTree
 
 #pragma endregion FileSystemStorageAdapter
 
+#pragma region CachedStorageAdapter
+
+	CachedStorageAdapter::CachedStorageAdapter(shared_ptr<AbsStorageAdapter> storage, number capacity) :
+		AbsStorageAdapter(storage->getBlockSize()),
+		storage(storage),
+		capacity(capacity)
+	{
+	}
+
+	CachedStorageAdapter::~CachedStorageAdapter()
+	{
+		{
+			lock_guard<mutex> guard(recorderLock);
+			stopping = true;
+		}
+		recorderStop.notify_all();
+		if (recorder.joinable())
+		{
+			recorder.join();
+		}
+	}
+
+	void CachedStorageAdapter::get(number location, bytes &response) const
+	{
+		get(location, response, true);
+	}
+
+	void CachedStorageAdapter::getOnce(number location, bytes &response) const
+	{
+		get(location, response, false);
+	}
+
+	void CachedStorageAdapter::get(number location, bytes &response, bool admit) const
+	{
+		{
+			lock_guard<mutex> guard(lock);
+			auto entry = entries.find(location);
+			if (entry != entries.end())
+			{
+				hitCount++;
+				if (entry->second.queue == Am)
+				{
+					am.splice(am.begin(), am, entry->second.position);
+				}
+				response.insert(response.begin(), entry->second.data.begin(), entry->second.data.end());
+				return;
+			}
+			missCount++;
+		}
+
+		// do not hold the lock while reading the storage
+		bytes read;
+		storage->get(location, read);
+		response.insert(response.begin(), read.begin(), read.end());
+
+		if (!admit)
+		{
+			return;
+		}
+
+		lock_guard<mutex> guard(lock);
+		if (capacity == 0 || entries.find(location) != entries.end())
+		{
+			// no room, or admitted by another thread in the meantime
+			return;
+		}
+
+		// a block seen recently (its address is in A1out) is hot, it goes to the main queue
+		auto ghost = ghosts.find(location);
+		if (ghost != ghosts.end())
+		{
+			a1out.erase(ghost->second);
+			ghosts.erase(ghost);
+			am.push_front(location);
+			entries[location] = {read, Am, am.begin()};
+		}
+		else
+		{
+			a1in.push_front(location);
+			entries[location] = {read, A1in, a1in.begin()};
+		}
+
+		reclaim();
+	}
+
+	void CachedStorageAdapter::reclaim() const
+	{
+		// the 2Q tuning from the paper: A1in holds a quarter of the capacity, A1out remembers half as many addresses
+		auto inCapacity	 = max(capacity / 4, 1uLL);
+		auto outCapacity = max(capacity / 2, 1uLL);
+
+		while (entries.size() > capacity)
+		{
+			if (a1in.size() > inCapacity || am.empty())
+			{
+				auto location = a1in.back();
+				a1in.pop_back();
+				entries.erase(location);
+
+				a1out.push_front(location);
+				ghosts[location] = a1out.begin();
+				if (a1out.size() > outCapacity)
+				{
+					ghosts.erase(a1out.back());
+					a1out.pop_back();
+				}
+			}
+			else
+			{
+				entries.erase(am.back());
+				am.pop_back();
+			}
+		}
+	}
+
+	void CachedStorageAdapter::set(number location, const bytes &data)
+	{
+		storage->set(location, data);
+
+		lock_guard<mutex> guard(lock);
+		auto entry = entries.find(location);
+		if (entry != entries.end())
+		{
+			entry->second.data = data;
+		}
+	}
+
+	number CachedStorageAdapter::malloc()
+	{
+		return storage->malloc();
+	}
+
+	number CachedStorageAdapter::empty() const
+	{
+		return storage->empty();
+	}
+
+	number CachedStorageAdapter::meta() const
+	{
+		return storage->meta();
+	}
+
+	number CachedStorageAdapter::size() const
+	{
+		return storage->size();
+	}
+
+	number CachedStorageAdapter::advance(number location, number count) const
+	{
+		return storage->advance(location, count);
+	}
+
+	void CachedStorageAdapter::willNeed(const vector<number> &locations) const
+	{
+		vector<number> missing;
+		{
+			lock_guard<mutex> guard(lock);
+			for (auto location : locations)
+			{
+				if (entries.find(location) == entries.end())
+				{
+					missing.push_back(location);
+				}
+			}
+		}
+
+		if (!missing.empty())
+		{
+			storage->willNeed(missing);
+		}
+	}
+
+	void CachedStorageAdapter::adviseSequential(number location, number count) const
+	{
+		storage->adviseSequential(location, count);
+	}
+
+	void CachedStorageAdapter::adviseRandom() const
+	{
+		storage->adviseRandom();
+	}
+
+	void CachedStorageAdapter::warm(const vector<number> &locations) const
+	{
+		for (auto location : locations)
+		{
+			{
+				lock_guard<mutex> guard(lock);
+				if (entries.find(location) != entries.end() || capacity == 0)
+				{
+					continue;
+				}
+			}
+
+			bytes read;
+			storage->get(location, read);
+
+			lock_guard<mutex> guard(lock);
+			if (entries.find(location) != entries.end())
+			{
+				continue;
+			}
+			am.push_front(location);
+			entries[location] = {read, Am, am.begin()};
+			reclaim();
+		}
+	}
+
+	vector<number> CachedStorageAdapter::hotSet() const
+	{
+		lock_guard<mutex> guard(lock);
+
+		vector<number> result(am.begin(), am.end());
+		result.insert(result.end(), a1in.begin(), a1in.end());
+
+		return result;
+	}
+
+	void CachedStorageAdapter::saveWarmSet(string filename) const
+	{
+		auto locations = hotSet();
+		auto temporary = filename + ".tmp";
+
+		{
+			ofstream file(temporary, ios::binary | ios::trunc);
+			file.write((const char *)locations.data(), locations.size() * sizeof(number));
+			if (!file)
+			{
+				throw Exception(boost::format("cannot write %1%: %2%") % temporary % strerror(errno));
+			}
+		}
+
+		if (rename(temporary.c_str(), filename.c_str()) != 0)
+		{
+			throw Exception(boost::format("cannot write %1%: %2%") % filename % strerror(errno));
+		}
+	}
+
+	vector<number> CachedStorageAdapter::loadWarmSet(string filename)
+	{
+		ifstream file(filename, ios::binary | ios::ate);
+		if (!file)
+		{
+			return {};
+		}
+
+		vector<number> locations((number)file.tellg() / sizeof(number));
+		file.seekg(0);
+		file.read((char *)locations.data(), locations.size() * sizeof(number));
+
+		return locations;
+	}
+
+	void CachedStorageAdapter::recordWarmSet(string filename, chrono::milliseconds period)
+	{
+		if (recorder.joinable())
+		{
+			throw Exception("the warm set is already being recorded");
+		}
+
+		recorder = thread([this, filename, period]() {
+			unique_lock<mutex> guard(recorderLock);
+			while (true)
+			{
+				auto stopped = recorderStop.wait_for(guard, period, [this] { return stopping; });
+				try
+				{
+					saveWarmSet(filename);
+				}
+				catch (const Exception &)
+				{
+					// the next save may succeed, the warm set is only an optimization
+				}
+				if (stopped)
+				{
+					return;
+				}
+			}
+		});
+	}
+
+	number CachedStorageAdapter::hits() const
+	{
+		lock_guard<mutex> guard(lock);
+		return hitCount;
+	}
+
+	number CachedStorageAdapter::misses() const
+	{
+		lock_guard<mutex> guard(lock);
+		return missCount;
+	}
+
+	number CachedStorageAdapter::cached() const
+	{
+		lock_guard<mutex> guard(lock);
+		return entries.size();
+	}
+
+	number CachedStorageAdapter::memoryUsage() const
+	{
+		lock_guard<mutex> guard(lock);
+		return entries.size() * entrySize();
+	}
+
+	number CachedStorageAdapter::benefit() const
+	{
+		return hits();
+	}
+
+	void CachedStorageAdapter::setBudget(number budget)
+	{
+		lock_guard<mutex> guard(lock);
+		capacity = budget / entrySize();
+		reclaim();
+	}
+
+	number CachedStorageAdapter::entrySize() const
+	{
+		return blockSize + sizeof(Entry) + sizeof(number) + 6 * sizeof(void *);
+	}
+
+#pragma endregion CachedStorageAdapter
 }
@@ -0,0 +1,90 @@
+#include "thread-pool.hpp"
+
+namespace BPlusTree
+{
+	using namespace std;
+
+	ThreadPool::ThreadPool(number threads, number capacity) :
+		state(make_shared<State>())
+	{
+		if (threads == 0)
+		{
+			throw Exception("thread pool needs at least one thread");
+		}
+
+		state->capacity = capacity;
+		for (number i = 0; i < threads; i++)
+		{
+			workers.push_back(thread(&ThreadPool::work, state));
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			lock_guard<mutex> guard(state->lock);
+			state->stopping = true;
+		}
+		state->available.notify_all();
+
+		for (auto &worker : workers)
+		{
+			// a worker cannot join itself, it keeps the state alive and drains the queue with the others
+			if (worker.get_id() == this_thread::get_id())
+			{
+				worker.detach();
+			}
+			else
+			{
+				worker.join();
+			}
+		}
+	}
+
+	bool ThreadPool::submit(function<void()> task)
+	{
+		{
+			lock_guard<mutex> guard(state->lock);
+			if (state->stopping || state->tasks.size() + state->active >= state->capacity)
+			{
+				return false;
+			}
+			state->tasks.push(move(task));
+		}
+		state->available.notify_one();
+
+		return true;
+	}
+
+	number ThreadPool::inFlight()
+	{
+		lock_guard<mutex> guard(state->lock);
+		return state->tasks.size() + state->active;
+	}
+
+	void ThreadPool::work(shared_ptr<State> state)
+	{
+		while (true)
+		{
+			function<void()> task;
+			{
+				unique_lock<mutex> guard(state->lock);
+				state->available.wait(guard, [&state] { return state->stopping || !state->tasks.empty(); });
+				if (state->tasks.empty())
+				{
+					return;
+				}
+				task = move(state->tasks.front());
+				state->tasks.pop();
+				state->active++;
+			}
+
+			// the task (and whatever it holds) is released before the next one is taken
+			task();
+			task = nullptr;
+
+			lock_guard<mutex> guard(state->lock);
+			state->active--;
+		}
+	}
+}
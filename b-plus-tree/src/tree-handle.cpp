@@ -0,0 +1,84 @@
+#include "tree-handle.hpp"
+
+#include <functional>
+#include <thread>
+
+namespace BPlusTree
+{
+	using namespace std;
+
+	TreeHandle::TreeHandle(shared_ptr<const Tree> tree) :
+		current(new Version{tree, 0})
+	{
+	}
+
+	TreeHandle::~TreeHandle()
+	{
+		delete current.load();
+	}
+
+	shared_ptr<const Tree> TreeHandle::acquire() const
+	{
+		number epoch;
+		return acquire(epoch);
+	}
+
+	shared_ptr<const Tree> TreeHandle::acquire(number &epoch) const
+	{
+		// claim a free slot by announcing the current version in it, the threads start at different slots
+		thread_local auto start = hash<thread::id>()(this_thread::get_id()) % SLOTS;
+		Slot *slot;
+		Version *version;
+		for (auto i = start;; i = (i + 1) % SLOTS)
+		{
+			Version *free = nullptr;
+			version		  = current.load();
+			if (slots[i].version.compare_exchange_strong(free, version))
+			{
+				slot = &slots[i];
+				break;
+			}
+		}
+
+		// the version may have been replaced (and retired) before it was announced, then announce the new one
+		for (auto now = current.load(); now != version; now = current.load())
+		{
+			version = now;
+			slot->version.store(version);
+		}
+
+		// the announced version is not freed until the slot is released
+		auto tree = version->tree;
+		epoch	  = version->epoch;
+		slot->version.store(nullptr);
+
+		return tree;
+	}
+
+	shared_ptr<const Tree> TreeHandle::publish(shared_ptr<const Tree> tree)
+	{
+		lock_guard<mutex> guard(publishLock);
+
+		unique_ptr<Version> previous(current.load());
+		current.store(new Version{tree, previous->epoch + 1});
+
+		// a reader that has announced the previous version is copying its reference right now,
+		// the ones that announce it from now on see the new version and move on
+		for (auto &slot : slots)
+		{
+			while (slot.version.load() == previous.get())
+			{
+				this_thread::yield();
+			}
+		}
+
+		return previous->tree;
+	}
+
+	number TreeHandle::epoch() const
+	{
+		number epoch;
+		acquire(epoch);
+		return epoch;
+	}
+}
@@ -3,7 +3,14 @@
 #include "utility.hpp"
 
 #include <algorithm>
+#include <cstring>
+#include <map>
 #include <math.h>
+#include <pthread.h>
+#include <random>
+#include <sched.h>
+#include <sys/uio.h>
+#include <thread>
 
 namespace BPlusTree
 {
@@ -13,111 +20,1481 @@ namespace BPlusTree
 	pair<BlockType, number> getTypeSize(number typeAndSize);
 	number setTypeSize(BlockType type, number size);
 
+	/**
+	 * @brief the decoded header of the first storage block of a Data Block
+	 *
+	 */
+	struct DataBlockHeader
+	{
+		number key;
+		number nextBucket;
+		number nextBlock;
+		// the pointer to the payload bytes in the storage block, the number of them and the room for them
+		const uchar *payload;
+		number size;
+		number capacity;
+	};
+	DataBlockHeader decodeDataBlockHeader(const bytes &block);
+	number writeAll(int descriptor, const vector<bytes> &chunks);
+
+	QueryControl::QueryControl(chrono::steady_clock::time_point deadline) :
+		deadline(deadline)
+	{
+	}
+
+	void QueryControl::cancel()
+	{
+		cancelled = true;
+	}
+
+	bool QueryControl::expired() const
+	{
+		return cancelled || (deadline != chrono::steady_clock::time_point::max() && chrono::steady_clock::now() >= deadline);
+	}
+
+	void QueryControl::truncate()
+	{
+		truncatedFlag = true;
+	}
+
+	bool QueryControl::truncated() const
+	{
+		return truncatedFlag;
+	}
+
 	Tree::Tree(shared_ptr<AbsStorageAdapter> storage) :
 		storage(storage)
 	{
-		b = (storage->getBlockSize() - sizeof(number)) / (2 * sizeof(number));
-		if (b < 2)
+		b = (storage->getBlockSize() - sizeof(number)) / (2 * sizeof(number));
+		if (b < 2)
+		{
+			throw Exception("storage block size too small for the tree");
+		}
+
+		// the meta block holds the root address, the statistics address (EMPTY for the trees stored without them)
+		// and the secret key of the continuation tokens (zero for the trees stored without it, generated below)
+		bytes metaBytes;
+		storage->get(storage->meta(), metaBytes);
+		metaBytes.resize(4 * sizeof(number));
+		auto meta	   = deconstructNumbers(metaBytes);
+		root		   = meta[0];
+		auto statsRoot = meta[1];
+		secret		   = {meta[2], meta[3]};
+
+		if (secret == pair<number, number>(0, 0))
+		{
+			// a storage written without the secret (or a fresh one) gets it now, a known key would let the tokens be forged
+			random_device device;
+			secret = {((number)device() << 32) | device(), ((number)device() << 32) | device()};
+
+			metaBytes = concatNumbers(4, root, statsRoot, secret.first, secret.second);
+			metaBytes.resize(storage->getBlockSize());
+			storage->set(storage->meta(), metaBytes);
+		}
+
+		// the tree is balanced, so one descent of the rightmost path gives both the height and the records,
+		// each node is read once and the descent stops at the first storage block of the last Data Block
+		vector<number> sizes;
+		for (auto address = root; address != storage->empty();)
+		{
+			auto [type, block] = checkType(address);
+			if (type != NodeBlock)
+			{
+				break;
+			}
+			auto node = readNodeBlock(block);
+			sizes.push_back(node.size());
+			address = node.back().second;
+		}
+		height = sizes.size();
+
+		// all nodes left of the rightmost path are full
+		records	  = 0;
+		auto span = rootSpan();
+		for (number depth = 1; depth <= height; depth++, span /= b)
+		{
+			records += (sizes[depth - 1] - 1) * span + (depth == height ? 1 : 0);
+		}
+
+		if (statsRoot != storage->empty())
+		{
+			statistics = readStats(statsRoot);
+		}
+	}
+
+	Tree::Tree(shared_ptr<AbsStorageAdapter> storage, vector<pair<number, bytes>> &data) :
+		Tree(storage)
+	{
+		sort(data.begin(), data.end(), [](const pair<number, bytes> &a, const pair<number, bytes> &b) { return a.first < b.first; });
+
+		// data layer
+		// the addresses are allocated in the key order, so that the scans read forward and the readahead helps
+		vector<vector<number>> addresses;
+		addresses.resize(data.size());
+		for (uint i = 0; i < data.size(); i++)
+		{
+			addresses[i].resize(dataBlockSize(data[i].second.size()));
+			for (auto &address : addresses[i])
+			{
+				address = storage->malloc();
+			}
+		}
+
+		// the blocks are written in reverse, since each needs the address of the next
+		vector<pair<number, number>> layer;
+		layer.resize(data.size());
+		for (int i = data.size() - 1; i >= 0; i--)
+		{
+			layer[i].first	= data[i].first;
+			layer[i].second = createDataBlock(
+				data[i].second,
+				data[i].first,
+				(uint)i == data.size() - 1 ? storage->empty() : layer[i + 1].second,
+				addresses[i]);
+		}
+		leftmostDataBlock = layer[0].second;
+		records			  = data.size();
+
+		// leaf layer
+		layer  = pushLayer(layer);
+		height = 1;
+
+		// nodes layer
+		while (layer.size() > 1)
+		{
+			layer = pushLayer(layer);
+			height++;
+		}
+		root = layer[0].second;
+
+		statistics = computeStats(data);
+
+		// a tree rebuilt in the same storage keeps the secret (read or generated on open), so that its tokens stay valid
+		auto metaBytes = concatNumbers(4, root, writeStats(statistics), secret.first, secret.second);
+		metaBytes.resize(storage->getBlockSize());
+		storage->set(storage->meta(), metaBytes);
+	}
+
+	Tree::~Tree()
+	{
+		unique_lock<mutex> guard(asyncLock);
+		drained.wait(guard, [this] { return pending == 0; });
+	}
+
+	void Tree::search(number key, vector<bytes> &response) const
+	{
+		return search(key, key, response);
+	}
+
+	void Tree::search(number start, number end, vector<bytes> &response) const
+	{
+		return search(start, end, response, SearchOptions());
+	}
+
+	void Tree::search(number key, vector<bytes> &response, const SearchOptions &options) const
+	{
+		return search(key, key, response, options);
+	}
+
+	void Tree::search(number start, number end, vector<bytes> &response, const SearchOptions &options) const
+	{
+		// the results filtered by a predicate are not cached, the predicate cannot be a part of the key
+		auto cached	  = resultCache && options.conditions.empty() && !options.predicate;
+		ResultKey key = {start, end, options.offset, options.length, options.limit};
+		if (cached && resultCache->lookup(key, response))
+		{
+			return;
+		}
+
+		// a new element is started on the first slice of each payload
+		vector<bytes> found;
+		auto fresh = true;
+		search(
+			start,
+			end,
+			[&found, &fresh](number key, const uchar *data, number size, bool last) {
+				if (fresh)
+				{
+					found.push_back(bytes());
+				}
+				found.back().insert(found.back().end(), data, data + size);
+				fresh = last;
+			},
+			options);
+
+		if (cached && !(options.control && options.control->truncated()))
+		{
+			resultCache->insert(key, found);
+		}
+		move(found.begin(), found.end(), back_inserter(response));
+	}
+
+	void Tree::search(number start, number end, const PayloadConsumer &consumer, const SearchOptions &options) const
+	{
+		if (options.limit == 0)
+		{
+			return;
+		}
+
+		if (start == end)
+		{
+			// a point lookup, the readahead would only pollute the page cache
+			storage->adviseRandom();
+		}
+
+		auto address = root;
+		while (true)
+		{
+			if (stopped(options))
+			{
+				return;
+			}
+
+			if (auto node = pinnedNode(address))
+			{
+				address = findChild(*node, start);
+				if (address == storage->empty())
+				{
+					return;
+				}
+				continue;
+			}
+
+			auto [type, read] = checkType(address);
+			switch (type)
+			{
+				case NodeBlock:
+				{
+					address = findChild(readNodeBlock(read), start);
+					if (address == storage->empty())
+					{
+						// key is larger than the largest
+						return;
+					}
+					break;
+				}
+				case DataBlock:
+				{
+					number advised = 0;
+					for (number taken = 0;;)
+					{
+						if (start < end && options.limit > 1)
+						{
+							// the chain is laid out in the address order, let the storage read ahead
+							readAhead(address, advised);
+						}
+						// the key is in the first storage block, so the payload is not read unless in range
+						auto [key, nextBucket] = readDataBlockHeader(read);
+						if (key < start || key > end)
+						{
+							// if we have read the block outside of the range, we are done
+							return;
+						}
+						if (start < end && taken + 1 < options.limit && nextBucket != storage->empty())
+						{
+							// the next Data Block is likely in the range, let the storage fetch it while this one is decoded
+							storage->willNeed({nextBucket});
+						}
+						if (matches(read, options))
+						{
+							readDataBlock(read, options, consumer);
+							taken++;
+						}
+						if (nextBucket == storage->empty() || taken == options.limit)
+						{
+							// if it is the last block in the linked list (or enough have been read), we are done
+							return;
+						}
+						if (stopped(options))
+						{
+							return;
+						}
+						address = nextBucket;
+						read	= checkType(address, !options.cache).second;
+					}
+				}
+			}
+		}
+	}
+
+	number Tree::search(number start, number end, int descriptor, const SearchOptions &options) const
+	{
+		// slices are written in batches with a single writev call
+		vector<bytes> pending;
+		number written = 0;
+
+		search(
+			start,
+			end,
+			[&pending, &written, descriptor](number key, const uchar *data, number size, bool last) {
+				if (size > 0)
+				{
+					pending.push_back(bytes(data, data + size));
+				}
+				if (pending.size() == WRITE_BATCH)
+				{
+					written += writeAll(descriptor, pending);
+					pending.clear();
+				}
+			},
+			options);
+		written += writeAll(descriptor, pending);
+
+		return written;
+	}
+
+	void Tree::search(const vector<number> &keys, vector<vector<bytes>> &response, const SearchOptions &options) const
+	{
+		response.clear();
+		response.resize(keys.size());
+
+		if (options.limit == 0)
+		{
+			return;
+		}
+
+		// the lookups jump all over the storage, the readahead would only pollute the page cache
+		storage->adviseRandom();
+
+		// the state of a single lookup in flight: the index of its key and the address of the block it needs next
+		vector<pair<uint, number>> inFlight;
+		uint admitted = 0;
+
+		while ((admitted < keys.size() || !inFlight.empty()) && !stopped(options))
+		{
+			// keep the window full
+			while (inFlight.size() < BATCH_WIDTH && admitted < keys.size())
+			{
+				inFlight.push_back({admitted++, root});
+			}
+
+			// advance every lookup by one block, prefetching the block it needs next;
+			// by the time the round comes back to it, the block is hopefully in cache
+			for (uint i = 0; i < inFlight.size();)
+			{
+				auto &[index, address] = inFlight[i];
+				auto key			   = keys[index];
+
+				if (auto node = pinnedNode(address))
+				{
+					address = findChild(*node, key);
+				}
+				else
+				{
+					auto [type, read] = checkType(address);
+					switch (type)
+					{
+						case NodeBlock:
+							address = findChild(readNodeBlock(read), key);
+							break;
+						case DataBlock:
+						{
+							auto [found, nextBucket] = readDataBlockHeader(read);
+							if (found != key)
+							{
+								address = storage->empty();
+								break;
+							}
+							if (matches(read, options))
+							{
+								auto &payload = response[index].emplace_back();
+								readDataBlock(read, options, [&payload](number key, const uchar *data, number size, bool last) {
+									payload.insert(payload.end(), data, data + size);
+								});
+							}
+							address = response[index].size() < options.limit ? nextBucket : storage->empty();
+							break;
+						}
+					}
+				}
+
+				if (address == storage->empty())
+				{
+					// this lookup is done, its slot is taken by the last one
+					inFlight[i] = inFlight.back();
+					inFlight.pop_back();
+				}
+				else
+				{
+					storage->willNeed({address});
+					i++;
+				}
+			}
+		}
+	}
+
+	void Tree::search(const vector<pair<number, number>> &ranges, vector<vector<bytes>> &response, const SearchOptions &options) const
+	{
+		response.clear();
+		response.resize(ranges.size());
+
+		vector<uint> order;
+		for (uint i = 0; i < ranges.size(); i++)
+		{
+			order.push_back(i);
+		}
+		stable_sort(order.begin(), order.end(), [&ranges](uint a, uint b) { return ranges[a].first < ranges[b].first; });
+
+		Sweep state;
+		for (auto index : order)
+		{
+			auto fresh = true;
+			sweep(
+				state,
+				ranges[index].first,
+				ranges[index].second,
+				[&response, &fresh, index](number key, const uchar *data, number size, bool last) {
+					if (fresh)
+					{
+						response[index].push_back(bytes());
+					}
+					response[index].back().insert(response[index].back().end(), data, data + size);
+					fresh = last;
+				},
+				options);
+		}
+	}
+
+	number Tree::join(const ProbeSource &probes, const PayloadConsumer &consumer, const SearchOptions &options) const
+	{
+		Sweep state;
+		number matched = 0;
+		number key;
+		while (!stopped(options) && probes(key))
+		{
+			matched += sweep(state, key, key, consumer, options);
+		}
+
+		return matched;
+	}
+
+	number Tree::join(int descriptor, const PayloadConsumer &consumer, const SearchOptions &options) const
+	{
+		number keys[PROBE_BATCH];
+		// the bytes in the buffer (the whole keys and the start of a partial one) and the next key to return
+		number filled	= 0;
+		number position = 0;
+
+		return join(
+			[&keys, &filled, &position, descriptor](number &key) {
+				if (position == filled / sizeof(number))
+				{
+					// keep the partial key, it is completed by the next read (a key may arrive in parts, e.g. from a pipe)
+					auto partial = filled % sizeof(number);
+					memmove(keys, (uchar *)keys + filled - partial, partial);
+					filled	 = partial;
+					position = 0;
+
+					// the keys are processed as soon as one is whole, a slow producer does not hold back the join
+					while (filled < sizeof(number))
+					{
+						auto result = read(descriptor, (uchar *)keys + filled, sizeof(keys) - filled);
+						if (result < 0 && errno == EINTR)
+						{
+							continue;
+						}
+						if (result < 0)
+						{
+							throw Exception(boost::format("cannot read from descriptor %1%: %2%") % descriptor % strerror(errno));
+						}
+						if (result == 0)
+						{
+							if (filled > 0)
+							{
+								throw Exception(boost::format("descriptor %1% ended in the middle of a key") % descriptor);
+							}
+							return false;
+						}
+						filled += result;
+					}
+				}
+				key = keys[position++];
+				return true;
+			},
+			consumer,
+			options);
+	}
+
+	number Tree::join(const Tree &other, number start, number end, number distance, const JoinConsumer &consumer, number threads, const SearchOptions &options) const
+	{
+		if (start > end)
+		{
+			return 0;
+		}
+
+		auto keys = splitKeys(start, end, max(threads, 1uLL));
+		if (keys.empty())
+		{
+			return joinRange(other, start, end, distance, consumer, options);
+		}
+
+		// same partitioning as in searchParallel
+		vector<future<vector<tuple<number, bytes, number, bytes>>>> parts;
+		for (uint i = 0; i <= keys.size(); i++)
+		{
+			auto from = i == 0 ? start : keys[i - 1] + 1;
+			auto to	  = i == keys.size() ? end : keys[i];
+
+			parts.push_back(async(launch::async, [this, &other, from, to, distance, &options]() {
+				vector<tuple<number, bytes, number, bytes>> matches;
+				joinRange(
+					other,
+					from,
+					to,
+					distance,
+					[&matches](number key, const bytes &payload, number otherKey, const bytes &otherPayload) {
+						matches.push_back({key, payload, otherKey, otherPayload});
+					},
+					options);
+				return matches;
+			}));
+		}
+
+		number matched = 0;
+		for (auto &part : parts)
+		{
+			for (auto &[key, payload, otherKey, otherPayload] : part.get())
+			{
+				consumer(key, payload, otherKey, otherPayload);
+				matched++;
+			}
+		}
+
+		return matched;
+	}
+
+	number Tree::joinRange(const Tree &other, number start, number end, number distance, const JoinConsumer &consumer, const SearchOptions &options) const
+	{
+		// positions the cursor at the Data Block, prefetching the next one
+		auto load = [&options](const Tree &tree, number address, bytes &read, number &advised) {
+			read.clear();
+			if (address != tree.storage->empty())
+			{
+				tree.readAhead(address, advised);
+				read			= tree.checkType(address, !options.cache).second;
+				auto nextBucket = tree.readDataBlockHeader(read).second;
+				if (nextBucket != tree.storage->empty())
+				{
+					tree.storage->willNeed({nextBucket});
+				}
+			}
+		};
+		auto payload = [&options](const Tree &tree, const bytes &read) {
+			bytes result;
+			tree.readDataBlock(
+				read,
+				options,
+				[&result](number key, const uchar *data, number size, bool last) {
+					result.insert(result.end(), data, data + size);
+				});
+			return result;
+		};
+
+		auto address	  = findDataBlock(start);
+		auto otherAddress = other.findDataBlock(start - min(distance, start));
+		if (address == storage->empty() || otherAddress == other.storage->empty())
+		{
+			return 0;
+		}
+
+		bytes read, otherRead;
+		number advised = 0, otherAdvised = 0;
+		load(*this, address, read, advised);
+		load(other, otherAddress, otherRead, otherAdvised);
+
+		// the records of the other tree within the distance of the current key
+		deque<pair<number, bytes>> window;
+		number matched = 0;
+		while (!read.empty() && !stopped(options))
+		{
+			auto [key, nextBucket] = readDataBlockHeader(read);
+			if (key > end)
+			{
+				break;
+			}
+
+			auto lower = key - min(distance, key);
+			auto upper = key + min(distance, ULLONG_MAX - key);
+			while (!window.empty() && window.front().first < lower)
+			{
+				window.pop_front();
+			}
+			while (!otherRead.empty())
+			{
+				auto [otherKey, otherNextBucket] = other.readDataBlockHeader(otherRead);
+				if (otherKey > upper)
+				{
+					break;
+				}
+				if (otherKey >= lower && other.matches(otherRead, options))
+				{
+					window.push_back({otherKey, payload(other, otherRead)});
+				}
+				load(other, otherNextBucket, otherRead, otherAdvised);
+			}
+
+			if (!window.empty() && matches(read, options))
+			{
+				auto data = payload(*this, read);
+				for (auto &[otherKey, otherData] : window)
+				{
+					consumer(key, data, otherKey, otherData);
+					matched++;
+				}
+			}
+			load(*this, nextBucket, read, advised);
+		}
+
+		return matched;
+	}
+
+	void Tree::sample(number start, number end, number k, vector<bytes> &response, const SearchOptions &options) const
+	{
+		if (start > end || records == 0)
+		{
+			return;
+		}
+
+		// the limit caps the sample whether or not the range is larger than it
+		k = min(k, options.limit);
+
+		auto from  = rank(start);
+		auto to	   = end == ULLONG_MAX ? records : rank(end + 1);
+		auto count = to - from;
+		if (count <= k)
+		{
+			return search(start, end, response, options);
+		}
+
+		// the ranks are drawn in the order of a random permutation of [0, count) (a lazy Fisher-Yates shuffle),
+		// in batches of as many as are still missing, so the first k matching records form a uniform sample of them
+		thread_local mt19937_64 generator(random_device{}());
+		unordered_map<number, number> swapped;
+		auto at = [&swapped](number i) {
+			auto found = swapped.find(i);
+			return found == swapped.end() ? i : found->second;
+		};
+
+		map<number, bytes> sampled;
+		number drawn = 0;
+		while (sampled.size() < k && drawn < count)
+		{
+			vector<number> batch;
+			for (auto needed = k - sampled.size(); batch.size() < needed && drawn < count; drawn++)
+			{
+				auto other = uniform_int_distribution<number>(drawn, count - 1)(generator);
+				batch.push_back(at(other));
+				swapped[other] = at(drawn);
+			}
+			// the batch is read in the address order
+			sort(batch.begin(), batch.end());
+
+			for (auto rank : batch)
+			{
+				if (stopped(options))
+				{
+					break;
+				}
+
+				auto read = checkType(recordAt(from + rank), !options.cache).second;
+				if (!matches(read, options))
+				{
+					continue;
+				}
+
+				auto &payload = sampled[rank];
+				readDataBlock(read, options, [&payload](number key, const uchar *data, number size, bool last) {
+					payload.insert(payload.end(), data, data + size);
+				});
+			}
+			if (stopped(options))
+			{
+				break;
+			}
+		}
+
+		for (auto &[rank, payload] : sampled)
+		{
+			response.push_back(move(payload));
+		}
+	}
+
+	number Tree::estimateCount(number start, number end, number levels) const
+	{
+		if (start > end || records == 0)
+		{
+			return 0;
+		}
+
+		// at least the root is read
+		levels = max(levels, 1uLL);
+
+		auto from = rank(start, levels);
+		auto to	  = end == ULLONG_MAX ? records : rank(end + 1, levels);
+
+		return to > from ? to - from : 0;
+	}
+
+	const TreeStats &Tree::stats() const
+	{
+		return statistics;
+	}
+
+	TreeStats Tree::computeStats(const vector<pair<number, bytes>> &data)
+	{
+		TreeStats stats;
+		stats.records = data.size();
+		if (data.empty())
+		{
+			return stats;
+		}
+		stats.minKey = data.front().first;
+		stats.maxKey = data.back().first;
+
+		auto depth = (data.size() + HISTOGRAM_BUCKETS - 1) / HISTOGRAM_BUCKETS;
+		for (uint i = 0; i < data.size();)
+		{
+			// the records of the same key
+			auto j = i;
+			while (j < data.size() && data[j].first == data[i].first)
+			{
+				j++;
+			}
+			stats.distinct++;
+			stats.maxDuplicates = max(stats.maxDuplicates, (number)(j - i));
+
+			// a bucket is closed once it is deep enough
+			if (stats.histogram.empty() || stats.histogram.back().second >= depth)
+			{
+				stats.histogram.push_back({0, 0});
+			}
+			stats.histogram.back().first = data[i].first;
+			stats.histogram.back().second += j - i;
+
+			i = j;
+		}
+
+		return stats;
+	}
+
+	number Tree::writeStats(const TreeStats &stats)
+	{
+		auto blob = concatNumbers(6, stats.records, stats.distinct, stats.minKey, stats.maxKey, stats.maxDuplicates, (number)stats.histogram.size());
+		for (auto [key, count] : stats.histogram)
+		{
+			auto bucket = concatNumbers(2, key, count);
+			blob.insert(blob.end(), bucket.begin(), bucket.end());
+		}
+
+		return createDataBlock(blob, 0, storage->empty());
+	}
+
+	TreeStats Tree::readStats(number address) const
+	{
+		auto numbers = deconstructNumbers(get<0>(readDataBlock(checkType(address).second)));
+		if (numbers.size() < 6 || numbers.size() != 6 + 2 * numbers[5])
+		{
+			throw Exception(boost::format("malformed statistics block at %1%") % address);
+		}
+
+		TreeStats stats;
+		stats.records		= numbers[0];
+		stats.distinct		= numbers[1];
+		stats.minKey		= numbers[2];
+		stats.maxKey		= numbers[3];
+		stats.maxDuplicates = numbers[4];
+		for (number i = 0; i < numbers[5]; i++)
+		{
+			stats.histogram.push_back({numbers[6 + 2 * i], numbers[7 + 2 * i]});
+		}
+
+		return stats;
+	}
+
+	bool TreeStats::operator==(const TreeStats &other) const
+	{
+		return records == other.records && distinct == other.distinct && minKey == other.minKey && maxKey == other.maxKey && maxDuplicates == other.maxDuplicates && histogram == other.histogram;
+	}
+
+	number Tree::rank(number key, number levels) const
+	{
+		number result = 0;
+		auto address  = root;
+		auto span	  = rootSpan();
+		for (number depth = 1; depth <= height; depth++, span /= b)
+		{
+			auto node  = readNode(address);
+			auto child = find_if(node.begin(), node.end(), [key](const pair<number, number> &entry) { return key <= entry.first; });
+			if (child == node.end())
+			{
+				// all keys are smaller
+				return records;
+			}
+			result += (child - node.begin()) * span;
+			address = child->second;
+
+			if (depth == levels && depth < height)
+			{
+				// the position within the child is unknown, assume the middle (the rightmost child may be not full)
+				return min(result + span / 2, records);
+			}
+		}
+
+		return result;
+	}
+
+	number Tree::recordAt(number rank) const
+	{
+		auto address = root;
+		auto span	 = rootSpan();
+		for (number depth = 1; depth <= height; depth++, span /= b)
+		{
+			address = readNode(address)[rank / span].second;
+			rank %= span;
+		}
+
+		return address;
+	}
+
+	number Tree::rootSpan() const
+	{
+		number span = 1;
+		for (number depth = 1; depth < height; depth++)
+		{
+			span *= b;
+		}
+
+		return span;
+	}
+
+	bytes Tree::search(number start, number end, number count, vector<bytes> &response, const SearchOptions &options) const
+	{
+		if (start > end)
+		{
+			return bytes();
+		}
+
+		return page(findDataBlock(start), end, count, 0, 0, response, options);
+	}
+
+	bytes Tree::resume(const bytes &token, number count, vector<bytes> &response, const SearchOptions &options) const
+	{
+		// the size is checked first, a short token is never decoded
+		if (token.size() != 6 * sizeof(number))
+		{
+			throw Exception("malformed continuation token");
+		}
+		auto numbers = deconstructNumbers(token);
+		auto mac	 = numbers.back();
+		numbers.pop_back();
+		// the MAC covers the whole position, so neither the address nor the end can be moved past the original query
+		if (numbers[0] != TOKEN_MAGIC || mac != sipHash(secret, numbers))
+		{
+			throw Exception("malformed continuation token");
+		}
+		auto address = numbers[1];
+		auto key	 = numbers[2];
+		auto end	 = numbers[3];
+		auto skip	 = numbers[4];
+
+		// the tree may have been rebuilt in the same storage since the token was issued,
+		// then the address may no longer be a Data Block of the key
+		auto valid = false;
+		if (address != storage->empty())
+		{
+			try
+			{
+				auto [type, read] = checkType(address);
+				valid			  = type == DataBlock && readDataBlockHeader(read).first == key;
+			}
+			catch (Exception &)
+			{
+			}
+		}
+
+		if (!valid)
+		{
+			address = findDataBlock(key);
+			for (number skipped = 0; skipped < skip && address != storage->empty(); skipped++)
+			{
+				auto [found, nextBucket] = readDataBlockHeader(checkType(address).second);
+				if (found != key)
+				{
+					break;
+				}
+				address = nextBucket;
+			}
+		}
+
+		return page(address, end, count, key, skip, response, options);
+	}
+
+	bytes Tree::page(number address, number end, number count, number key, number skip, vector<bytes> &response, const SearchOptions &options) const
+	{
+		number taken = 0, advised = 0;
+		while (address != storage->empty())
+		{
+			readAhead(address, advised);
+			auto read				= checkType(address, !options.cache).second;
+			auto [found, nextBucket] = readDataBlockHeader(read);
+			if (found > end)
+			{
+				break;
+			}
+
+			// the records of the same key passed so far, in case the token needs to descend
+			skip = found == key ? skip : 0;
+			key	 = found;
+			if (taken == count || stopped(options))
+			{
+				// the page is full (or stopped early), the next one starts here
+				auto mac = sipHash(secret, {TOKEN_MAGIC, address, key, end, skip});
+				return concatNumbers(6, TOKEN_MAGIC, address, key, end, skip, mac);
+			}
+
+			if (matches(read, options))
+			{
+				auto fresh = true;
+				readDataBlock(
+					read,
+					options,
+					[&response, &fresh](number key, const uchar *data, number size, bool last) {
+						if (fresh)
+						{
+							response.push_back(bytes());
+						}
+						response.back().insert(response.back().end(), data, data + size);
+						fresh = last;
+					});
+				if (stopped(options))
+				{
+					// the record may have been cut short, the token points at it so that the next page returns it whole
+					response.pop_back();
+					continue;
+				}
+				taken++;
+			}
+			skip++;
+
+			if (nextBucket != storage->empty())
+			{
+				storage->willNeed({nextBucket});
+			}
+			address = nextBucket;
+		}
+
+		return bytes();
+	}
+
+	void Tree::readAhead(number address, number &advised) const
+	{
+		// the storage is not asked for every block, only when the previous window is half consumed
+		// (counted in storage blocks, a Data Block may span several)
+		if (storage->advance(address, READAHEAD / 2) >= advised)
+		{
+			storage->adviseSequential(address, READAHEAD);
+			advised = storage->advance(address, READAHEAD);
+		}
+	}
+
+	bool Tree::matches(const bytes &block, const SearchOptions &options) const
+	{
+		if (options.conditions.empty() && !options.predicate)
+		{
+			return true;
+		}
+
+		auto header = decodeDataBlockHeader(block);
+
+		for (auto &condition : options.conditions)
+		{
+			// the offset and the size are compared separately, their sum may overflow
+			auto length = condition.value.size();
+			if (condition.offset > header.capacity || length > header.capacity - condition.offset)
+			{
+				throw Exception(boost::format("payload condition of %1% bytes at %2% is past the first storage block (%3% bytes)") % length % condition.offset % header.capacity);
+			}
+			if (condition.offset > header.size || length > header.size - condition.offset)
+			{
+				return false;
+			}
+
+			auto order = memcmp(header.payload + condition.offset, condition.value.data(), length);
+			bool holds;
+			switch (condition.comparison)
+			{
+				case PayloadCondition::Equal:
+					holds = order == 0;
+					break;
+				case PayloadCondition::NotEqual:
+					holds = order != 0;
+					break;
+				case PayloadCondition::Less:
+					holds = order < 0;
+					break;
+				case PayloadCondition::LessOrEqual:
+					holds = order <= 0;
+					break;
+				case PayloadCondition::Greater:
+					holds = order > 0;
+					break;
+				case PayloadCondition::GreaterOrEqual:
+				default:
+					holds = order >= 0;
+					break;
+			}
+			if (!holds)
+			{
+				return false;
+			}
+		}
+
+		return !options.predicate || options.predicate(header.key, header.payload, header.size);
+	}
+
+	bool Tree::stopped(const SearchOptions &options) const
+	{
+		if (options.control && options.control->expired())
+		{
+			options.control->truncate();
+			return true;
+		}
+
+		return false;
+	}
+
+	number Tree::findDataBlock(number start) const
+	{
+		auto address = root;
+		for (number depth = 1; depth <= height && address != storage->empty(); depth++)
+		{
+			address = findChild(readNode(address), start);
+		}
+
+		return address;
+	}
+
+	number Tree::sweep(Sweep &state, number start, number end, const PayloadConsumer &consumer, const SearchOptions &options) const
+	{
+		if (start > end || options.limit == 0 || stopped(options))
+		{
+			return 0;
+		}
+		if (state.path.empty() || start < state.lastStart)
+		{
+			state = {{readNode(root)}, {}, 0, start};
+		}
+		state.lastStart = start;
+
+		auto read = state.held;
+		if (state.held.empty() || state.heldAfter >= start || readDataBlockHeader(state.held).first < start)
+		{
+			// the held block is not the first one of the range (or there is none), descend from the lowest covering node
+			while (state.path.size() > 1 && start > state.path.back().back().first)
+			{
+				state.path.pop_back();
+			}
+
+			auto address = findChild(state.path.back(), start);
+			if (address == storage->empty())
+			{
+				// start is larger than the largest key
+				state.held.clear();
+				return 0;
+			}
+			while (state.path.size() < height)
+			{
+				state.path.push_back(readNode(address));
+				address = findChild(state.path.back(), start);
+			}
+			read = checkType(address, !options.cache).second;
+		}
+
+		state.held.clear();
+		state.heldAfter = end;
+
+		number found = 0;
+		while (true)
+		{
+			auto [key, nextBucket] = readDataBlockHeader(read);
+			if (key > end)
+			{
+				state.held = move(read);
+				return found;
+			}
+			if (start < end && nextBucket != storage->empty())
+			{
+				storage->willNeed({nextBucket});
+			}
+			if (matches(read, options))
+			{
+				readDataBlock(read, options, consumer);
+				found++;
+			}
+			if (nextBucket == storage->empty() || found == options.limit || stopped(options))
+			{
+				return found;
+			}
+			read = checkType(nextBucket, !options.cache).second;
+		}
+	}
+
+	void Tree::searchParallel(number start, number end, vector<bytes> &response, number threads, const SearchOptions &options) const
+	{
+		auto fresh = true;
+		searchParallel(
+			start,
+			end,
+			[&response, &fresh](number key, const uchar *data, number size, bool last) {
+				if (fresh)
+				{
+					response.push_back(bytes());
+				}
+				response.back().insert(response.back().end(), data, data + size);
+				fresh = last;
+			},
+			threads,
+			options);
+	}
+
+	void Tree::searchParallel(number start, number end, const PayloadConsumer &consumer, number threads, const SearchOptions &options) const
+	{
+		if (start > end)
 		{
-			throw Exception("storage block size too small for the tree");
+			return;
+		}
+
+		// a limited search is not split, the first records are all in the first sub-range
+		// and the other workers would read up to limit Data Blocks each for nothing
+		auto keys = options.limit == ULLONG_MAX ? splitKeys(start, end, max(threads, 1uLL)) : vector<number>();
+		if (keys.empty())
+		{
+			return search(start, end, consumer, options);
+		}
+
+		// sub-range i is [keys[i - 1] + 1, keys[i]], the first starts at start and the last ends at end
+		vector<future<vector<tuple<number, bytes, bool>>>> parts;
+		for (uint i = 0; i <= keys.size(); i++)
+		{
+			auto from = i == 0 ? start : keys[i - 1] + 1;
+			auto to	  = i == keys.size() ? end : keys[i];
+
+			parts.push_back(async(launch::async, [this, from, to, &options]() {
+				vector<tuple<number, bytes, bool>> slices;
+				search(
+					from,
+					to,
+					[&slices](number key, const uchar *data, number size, bool last) {
+						slices.push_back({key, bytes(data, data + size), last});
+					},
+					options);
+				return slices;
+			}));
 		}
 
-		bytes rootBytes;
-		storage->get(storage->meta(), rootBytes);
-		rootBytes.resize(sizeof(number));
-		if (numberFromBytes(rootBytes) != storage->empty())
+		// deliver in order, a sub-range as soon as it and all preceding ones are done
+		for (auto &part : parts)
 		{
-			root = numberFromBytes(rootBytes);
+			for (auto &[key, slice, last] : part.get())
+			{
+				consumer(key, slice.data(), slice.size(), last);
+			}
 		}
 	}
 
-	Tree::Tree(shared_ptr<AbsStorageAdapter> storage, vector<pair<number, bytes>> &data) :
-		Tree(storage)
+	vector<number> Tree::splitKeys(number start, number end, number parts) const
 	{
-		sort(data.begin(), data.end(), [](const pair<number, bytes> &a, const pair<number, bytes> &b) { return a.first < b.first; });
-
-		// data layer
-		vector<pair<number, number>> layer;
-		layer.resize(data.size());
-		for (int i = data.size() - 1; i >= 0; i--)
+		vector<number> keys;
+		vector<number> level = {root};
+		for (number depth = 1; depth <= height; depth++)
 		{
-			layer[i].first	= data[i].first;
-			layer[i].second = createDataBlock(
-				data[i].second,
-				data[i].first,
-				(uint)i == data.size() - 1 ? storage->empty() : layer[i + 1].second);
+			// the separators in [start, end) and the children overlapping the range
+			keys.clear();
+			vector<number> next;
+			for (auto address : level)
+			{
+				for (auto [key, child] : readNode(address))
+				{
+					if (key < start)
+					{
+						continue;
+					}
+					if (key < end)
+					{
+						keys.push_back(key);
+					}
+					next.push_back(child);
+					if (key >= end)
+					{
+						break;
+					}
+				}
+			}
+
+			if (keys.size() + 1 >= parts || next.empty())
+			{
+				break;
+			}
+			level = next;
 		}
-		leftmostDataBlock = layer[0].second;
 
-		// leaf layer
-		layer = pushLayer(layer);
+		keys.erase(unique(keys.begin(), keys.end()), keys.end());
+		if (keys.size() + 1 <= parts)
+		{
+			return keys;
+		}
 
-		// nodes layer
-		while (layer.size() > 1)
+		// pick parts - 1 evenly spaced keys
+		vector<number> result;
+		for (number i = 1; i < parts; i++)
 		{
-			layer = pushLayer(layer);
+			auto key = keys[i * keys.size() / parts];
+			if (result.empty() || result.back() != key)
+			{
+				result.push_back(key);
+			}
 		}
-		root = layer[0].second;
 
-		auto rootBytes = bytesFromNumber(root);
-		rootBytes.resize(storage->getBlockSize());
-		storage->set(storage->meta(), rootBytes);
+		return result;
 	}
 
-	void Tree::search(number key, vector<bytes> &response)
+	future<vector<bytes>> Tree::searchAsync(number key, const SearchOptions &options) const
 	{
-		return search(key, key, response);
+		return searchAsync(key, key, options);
 	}
 
-	void Tree::search(number start, number end, vector<bytes> &response)
+	future<vector<bytes>> Tree::searchAsync(number start, number end, const SearchOptions &options) const
 	{
-		auto address = root;
-		while (true)
+		auto result = make_shared<promise<vector<bytes>>>();
+		searchAsync(
+			start,
+			end,
+			[result](vector<bytes> response, exception_ptr error) {
+				if (error)
+				{
+					result->set_exception(error);
+				}
+				else
+				{
+					result->set_value(move(response));
+				}
+			},
+			options);
+
+		return result->get_future();
+	}
+
+	void Tree::searchAsync(number start, number end, const SearchCallback &callback, const SearchOptions &options) const
+	{
+		unique_lock<mutex> guard(asyncLock);
+		if (!pool)
 		{
-			auto [type, read] = checkType(address);
-			switch (type)
+			pool = make_shared<ThreadPool>(ASYNC_THREADS, ASYNC_CAPACITY);
+		}
+		pending++;
+
+		// a shared tree is kept alive by the search, so whoever drops the last other reference does not wait for it
+		auto self	  = weak_from_this().lock();
+		auto accepted = pool->submit([this, self, start, end, callback, options]() {
+			vector<bytes> response;
+			exception_ptr error;
+			try
 			{
-				case NodeBlock:
+				search(start, end, response, options);
+			}
+			catch (...)
+			{
+				response.clear();
+				error = current_exception();
+			}
+			{
+				// the tree is not touched past this point, so the callback may release the last reference to it
+				lock_guard<mutex> guard(asyncLock);
+				pending--;
+				drained.notify_all();
+			}
+			callback(move(response), error);
+		});
+
+		if (!accepted)
+		{
+			pending--;
+			auto error = make_exception_ptr(Exception(boost::format("too many operations in flight (%1%)") % pool->inFlight()));
+			guard.unlock();
+			callback({}, error);
+		}
+	}
+
+	future<void> Tree::warmUp(number levels, const vector<number> &locations)
+	{
+		auto done = make_shared<promise<void>>();
+		{
+			lock_guard<mutex> guard(asyncLock);
+			pending++;
+		}
+
+		thread([this, levels, locations, done]() {
+			try
+			{
+				// level by level, each level is loaded as a batch before its children are found
+				vector<number> level = {root};
+				for (number depth = 1; depth <= min(levels, height); depth++)
 				{
-					auto block = readNodeBlock(read);
-					address	   = storage->empty();
-					for (uint i = 0; i < block.size(); i++)
+					storage->warm(level);
+
+					vector<number> next;
+					for (auto address : level)
 					{
-						if (start <= block[i].first)
+						for (auto [key, child] : readNode(address))
 						{
-							address = block[i].second;
-							break;
+							next.push_back(child);
 						}
 					}
-					if (address == storage->empty())
-					{
-						// key is larger than the largest
-						return;
-					}
-					break;
+					level = next;
 				}
-				case DataBlock:
+
+				storage->warm(locations);
+				done->set_value();
+			}
+			catch (...)
+			{
+				done->set_exception(current_exception());
+			}
+
+			lock_guard<mutex> guard(asyncLock);
+			pending--;
+			drained.notify_all();
+		}).detach();
+
+		return done->get_future();
+	}
+
+	void Tree::setResultCache(shared_ptr<ResultCache> cache)
+	{
+		resultCache = cache;
+	}
+
+	void Tree::setThreadPool(shared_ptr<ThreadPool> pool)
+	{
+		lock_guard<mutex> guard(asyncLock);
+		this->pool = pool;
+	}
+
+	void Tree::pinLevels(number levels, bool replicate)
+	{
+		pinned.clear();
+		cpuReplicas.clear();
+		if (levels == 0)
+		{
+			return;
+		}
+
+		auto nodes = replicate ? numaTopology() : vector<vector<uint>>();
+		if (nodes.size() <= 1)
+		{
+			nodes.clear();
+		}
+
+		// builds a replica breadth-first from the root
+		auto build = [this, levels](unordered_map<number, vector<pair<number, number>>> &replica) {
+			vector<number> level = {root};
+			for (number depth = 1; depth <= min(levels, height); depth++)
+			{
+				vector<number> next;
+				for (auto address : level)
 				{
-					tuple<bytes, number, number> block;
-					while (true)
+					auto block		 = readNodeBlock(checkType(address).second);
+					replica[address] = block;
+					for (auto [key, child] : block)
 					{
-						auto block = readDataBlock(read);
-						if (get<1>(block) < start || get<1>(block) > end)
-						{
-							// if we have read the block outside of the range, we are done
-							return;
-						}
-						response.push_back(get<0>(block));
-						if (get<2>(block) == storage->empty())
-						{
-							// if it is the last block in the linked list, we are done
-							return;
-						}
-						read = checkType(get<2>(block)).second;
+						next.push_back(child);
 					}
 				}
+				level = next;
+			}
+		};
+
+		pinned.resize(max(nodes.size(), (size_t)1));
+		if (nodes.empty())
+		{
+			build(pinned[0]);
+			return;
+		}
+
+		// each replica is built by a thread bound to the node's CPUs, so that its memory is allocated on that node
+		for (uint node = 0; node < nodes.size(); node++)
+		{
+			for (auto cpu : nodes[node])
+			{
+				cpuReplicas.resize(max((size_t)cpu + 1, cpuReplicas.size()), 0);
+				cpuReplicas[cpu] = node;
+			}
+
+			thread builder([&build, &replica = pinned[node], &cpus = nodes[node]]() {
+				cpu_set_t set;
+				CPU_ZERO(&set);
+				for (auto cpu : cpus)
+				{
+					CPU_SET(cpu, &set);
+				}
+				pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+				build(replica);
+			});
+			builder.join();
+		}
+	}
+
+	number Tree::pinnedSize() const
+	{
+		number result = 0;
+		for (auto &replica : pinned)
+		{
+			for (auto &[address, block] : replica)
+			{
+				// the decoded pairs, the vector and the hash map node
+				result += block.size() * sizeof(pair<number, number>) + sizeof(block) + 4 * sizeof(number);
+			}
+		}
+
+		return result;
+	}
+
+	const vector<pair<number, number>> *Tree::pinnedNode(number address) const
+	{
+		if (pinned.empty())
+		{
+			return nullptr;
+		}
+
+		auto replica = 0u;
+		if (pinned.size() > 1)
+		{
+			auto cpu = sched_getcpu();
+			replica	 = cpu >= 0 && (uint)cpu < cpuReplicas.size() ? cpuReplicas[cpu] : 0;
+		}
+
+		auto node = pinned[replica].find(address);
+		return node == pinned[replica].end() ? nullptr : &node->second;
+	}
+
+	vector<pair<number, number>> Tree::readNode(number address) const
+	{
+		auto node = pinnedNode(address);
+		return node ? *node : readNodeBlock(checkType(address).second);
+	}
+
+	number Tree::findChild(const vector<pair<number, number>> &block, number key) const
+	{
+		for (uint i = 0; i < block.size(); i++)
+		{
+			if (key <= block[i].first)
+			{
+				return block[i].second;
 			}
 		}
+
+		return storage->empty();
 	}
 
 	vector<pair<number, number>> Tree::pushLayer(const vector<pair<number, number>> &input)
@@ -177,7 +1554,7 @@ namespace BPlusTree
 		return address;
 	}
 
-	vector<pair<number, number>> Tree::readNodeBlock(const bytes &block)
+	vector<pair<number, number>> Tree::readNodeBlock(const bytes &block) const
 	{
 		auto deconstructed = deconstruct(block, {sizeof(number)});
 		auto [type, size]  = getTypeSize(numberFromBytes(deconstructed[0]));
@@ -206,23 +1583,32 @@ namespace BPlusTree
 		return result;
 	}
 
-	number Tree::createDataBlock(const bytes &data, number key, number next)
+	number Tree::dataBlockSize(number size) const
 	{
 		// different if all fits in a single storage block, or not
 		auto firstBlockSize = storage->getBlockSize() - 4 * sizeof(number);
 		auto otherBlockSize = storage->getBlockSize() - 2 * sizeof(number);
 
-		auto blocks =
-			data.size() <= firstBlockSize ?
-				1 :
-				1 + (data.size() - firstBlockSize + otherBlockSize - 1) / otherBlockSize;
+		return size <= firstBlockSize ?
+				   1 :
+				   1 + (size - firstBlockSize + otherBlockSize - 1) / otherBlockSize;
+	}
+
+	number Tree::createDataBlock(const bytes &data, number key, number next, vector<number> addresses)
+	{
+		auto firstBlockSize = storage->getBlockSize() - 4 * sizeof(number);
+		auto otherBlockSize = storage->getBlockSize() - 2 * sizeof(number);
+
+		auto blocks = dataBlockSize(data.size());
 
 		// request necessary addresses in advance
-		vector<number> addresses;
-		addresses.resize(blocks);
-		for (uint i = 0; i < blocks; i++)
+		if (addresses.empty())
 		{
-			addresses[i] = storage->malloc();
+			addresses.resize(blocks);
+			for (uint i = 0; i < blocks; i++)
+			{
+				addresses[i] = storage->malloc();
+			}
 		}
 
 		// scan data block by block
@@ -258,73 +1644,124 @@ namespace BPlusTree
 		return addresses[0];
 	}
 
-	tuple<bytes, number, number> Tree::readDataBlock(const bytes &block)
+	tuple<bytes, number, number> Tree::readDataBlock(const bytes &block, number offset, number length) const
 	{
+		SearchOptions options;
+		options.offset = offset;
+		options.length = length;
+
 		bytes data;
-		auto address = storage->empty();
-		number nextBucket;
-		number key;
+		auto [key, nextBucket] = readDataBlock(
+			block,
+			options,
+			[&data](number key, const uchar *chunk, number size, bool last) {
+				data.insert(data.end(), chunk, chunk + size);
+			});
+
+		return {data, key, nextBucket};
+	}
+
+	pair<number, number> Tree::readDataBlock(const bytes &block, const SearchOptions &options, const PayloadConsumer &consumer) const
+	{
+		auto [key, nextBucket] = readDataBlockHeader(block);
 
+		auto offset = options.offset;
+		// the payload window [offset, windowEnd), guarded against overflow
+		auto windowEnd = options.length > ULLONG_MAX - offset ? ULLONG_MAX : offset + options.length;
+		// the payload offset of the current storage block
+		number position = 0;
+
+		bytes read;
+		auto current = &block;
+		auto first	 = true;
 		while (true)
 		{
-			auto first = address == storage->empty();
+			auto headerSize = (first ? 4 : 2) * sizeof(number);
+
+			number numbers[2];
+			copy(current->begin(), current->begin() + sizeof(numbers), (uchar *)numbers);
 
-			bytes read;
-			if (first)
+			auto [type, thisSize] = getTypeSize(numbers[0]);
+			if (type != DataBlock)
 			{
-				read.insert(read.begin(), block.begin(), block.end());
+				throw Exception("attempt to read a non-data block as data block");
 			}
-			else
+			thisSize = min(thisSize, (number)current->size() - headerSize);
+
+			auto nextBlock = numbers[1];
+			// no need to read the continuation blocks past the window
+			auto last = nextBlock == storage->empty() || position + thisSize >= windowEnd;
+
+			if (!last)
 			{
-				storage->get(address, read);
+				// let the storage fetch the continuation block while this slice is consumed
+				storage->willNeed({nextBlock});
 			}
 
-			auto deconstructed = deconstruct(read, {(first ? 4 : 2) * (int)sizeof(number)});
-			auto numbers	   = deconstructNumbers(deconstructed[0]);
-			auto blockData	   = deconstructed[1];
+			// hand over only the part of this storage block that overlaps with the window
+			auto from = max(position, offset);
+			auto to	  = min(position + thisSize, windowEnd);
+			if (from < to || last)
+			{
+				auto slice = current->data() + headerSize + (from < to ? from - position : 0);
+				consumer(key, slice, from < to ? to - from : 0, last);
+			}
+			position += thisSize;
 
-			auto [type, thisSize] = getTypeSize(numbers[0]);
-			if (type != DataBlock)
+			if (last)
 			{
-				throw Exception("attempt to read a non-data block as data block");
+				return {key, nextBucket};
 			}
-			auto nextBlock = numbers[1];
 
-			if (first)
+			if (stopped(options))
 			{
-				nextBucket = numbers[2];
-				key		   = numbers[3];
+				// a long payload is cut short too, the consumer still gets its last slice
+				consumer(key, current->data(), 0, true);
+				return {key, nextBucket};
 			}
-			blockData.resize(thisSize);
-			data = concat(2, &data, &blockData);
 
-			if (nextBlock != storage->empty())
+			read.clear();
+			if (!options.cache)
 			{
-				address = nextBlock;
-				continue;
+				storage->getOnce(nextBlock, read);
 			}
 			else
 			{
-				return {data, key, nextBucket};
+				storage->get(nextBlock, read);
 			}
+			current = &read;
+			first	= false;
 		}
 	}
 
-	pair<BlockType, bytes> Tree::checkType(number address)
+	pair<number, number> Tree::readDataBlockHeader(const bytes &block) const
+	{
+		auto header = decodeDataBlockHeader(block);
+		return {header.key, header.nextBucket};
+	}
+
+	pair<BlockType, bytes> Tree::checkType(number address, bool once) const
 	{
 		bytes block;
-		storage->get(address, block);
+		if (once)
+		{
+			storage->getOnce(address, block);
+		}
+		else
+		{
+			storage->get(address, block);
+		}
 		auto deconstructed = deconstruct(block, {sizeof(number)});
 		auto typeAndSize   = numberFromBytes(deconstructed[0]);
 		return {getTypeSize(typeAndSize).first, block};
 	}
 
-	void Tree::checkConsistency()
+	void Tree::checkConsistency() const
 	{
 		checkConsistency(root, ULONG_MAX, true);
 	}
 
-	void Tree::checkConsistency(number address, number largestKey, bool rightmost)
+	void Tree::checkConsistency(number address, number largestKey, bool rightmost) const
 	{
 		// helper to throw exception if condition fails
 		auto throwIf = [](bool expression, Exception exception) {
@@ -379,6 +1816,32 @@ namespace BPlusTree
 		}
 	}
 
+	/**
+	 * @brief decodes the header of the first storage block of a Data Block: type and size, next block, next bucket and key
+	 *
+	 * @param block the first storage block of the Data Block
+	 * @return DataBlockHeader the decoded header, the size of the payload is capped by the block
+	 */
+	DataBlockHeader decodeDataBlockHeader(const bytes &block)
+	{
+		const number headerSize = 4 * sizeof(number);
+		number numbers[4];
+		if (block.size() < headerSize)
+		{
+			throw Exception("attempt to read a non-data block as data block");
+		}
+		copy(block.begin(), block.begin() + headerSize, (uchar *)numbers);
+
+		auto [type, size] = getTypeSize(numbers[0]);
+		if (type != DataBlock)
+		{
+			throw Exception("attempt to read a non-data block as data block");
+		}
+
+		auto capacity = (number)block.size() - headerSize;
+		return {numbers[3], numbers[2], numbers[1], block.data() + headerSize, min(size, capacity), capacity};
+	}
+
 	/**
 	 * @brief deconstruct the number into type and size
 	 *
@@ -406,4 +1869,50 @@ namespace BPlusTree
 		uint buffer[2]{type, (uint)size};
 		return ((number *)buffer)[0];
 	}
+
+	/**
+	 * @brief writes all chunks to the file descriptor with as few writev calls as possible
+	 *
+	 * @param descriptor the file descriptor to write to
+	 * @param chunks the chunks to write (in order)
+	 * @return number the number of bytes written
+	 */
+	number writeAll(int descriptor, const vector<bytes> &chunks)
+	{
+		vector<iovec> vectors;
+		number total = 0;
+		for (auto &chunk : chunks)
+		{
+			vectors.push_back({(void *)chunk.data(), chunk.size()});
+			total += chunk.size();
+		}
+
+		uint i = 0;
+		while (i < vectors.size())
+		{
+			auto written = writev(descriptor, vectors.data() + i, min(vectors.size() - i, (size_t)IOV_MAX));
+			if (written < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				throw Exception(boost::format("cannot write to descriptor %1%: %2%") % descriptor % strerror(errno));
+			}
+
+			// skip fully written chunks and advance within a partially written one
+			while (i < vectors.size() && (size_t)written >= vectors[i].iov_len)
+			{
+				written -= vectors[i].iov_len;
+				i++;
+			}
+			if (i < vectors.size())
+			{
+				vectors[i].iov_base = (uchar *)vectors[i].iov_base + written;
+				vectors[i].iov_len -= written;
+			}
+		}
+
+		return total;
+	}
 }
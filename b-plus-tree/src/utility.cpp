@@ -3,8 +3,10 @@
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/format.hpp>
 #include <cstdarg>
+#include <fstream>
 #include <iomanip>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 namespace BPlusTree
@@ -97,8 +99,99 @@ namespace BPlusTree
 	{
 		auto count = data.size() / sizeof(number);
 
+		// the trailing bytes that do not make a whole number are ignored
 		uchar buffer[count * sizeof(number)];
-		copy(data.begin(), data.end(), buffer);
+		copy(data.begin(), data.begin() + count * sizeof(number), buffer);
 		return vector<number>((number *)buffer, (number *)buffer + count);
 	}
+
+	number sipHash(pair<number, number> key, const vector<number> &data)
+	{
+		auto rotate = [](number x, int bits) { return (x << bits) | (x >> (64 - bits)); };
+
+		number v0 = key.first ^ 0x736f6d6570736575uLL;
+		number v1 = key.second ^ 0x646f72616e646f6duLL;
+		number v2 = key.first ^ 0x6c7967656e657261uLL;
+		number v3 = key.second ^ 0x7465646279746573uLL;
+
+		auto round = [&]() {
+			v0 += v1;
+			v1 = rotate(v1, 13);
+			v1 ^= v0;
+			v0 = rotate(v0, 32);
+			v2 += v3;
+			v3 = rotate(v3, 16);
+			v3 ^= v2;
+			v0 += v3;
+			v3 = rotate(v3, 21);
+			v3 ^= v0;
+			v2 += v1;
+			v1 = rotate(v1, 17);
+			v1 ^= v2;
+			v2 = rotate(v2, 32);
+		};
+		auto compress = [&](number word) {
+			v3 ^= word;
+			round();
+			round();
+			v0 ^= word;
+		};
+
+		// SipHash-2-4 over the little-endian words, the message length (in bytes) goes into the last word
+		for (auto word : data)
+		{
+			compress(word);
+		}
+		compress((data.size() * sizeof(number)) << 56);
+
+		v2 ^= 0xff;
+		for (auto i = 0; i < 4; i++)
+		{
+			round();
+		}
+		return v0 ^ v1 ^ v2 ^ v3;
+	}
+
+	vector<vector<uint>> numaTopology()
+	{
+		vector<vector<uint>> nodes;
+		for (uint node = 0;; node++)
+		{
+			ifstream file(boost::str(boost::format("/sys/devices/system/node/node%1%/cpulist") % node));
+			if (!file)
+			{
+				break;
+			}
+
+			// the list looks like "0-3,8-11"
+			vector<uint> cpus;
+			string range;
+			while (getline(file, range, ','))
+			{
+				uint from, to;
+				auto parsed = sscanf(range.c_str(), "%u-%u", &from, &to);
+				if (parsed == 1)
+				{
+					to = from;
+				}
+				for (auto cpu = from; parsed >= 1 && cpu <= to; cpu++)
+				{
+					cpus.push_back(cpu);
+				}
+			}
+			nodes.push_back(cpus);
+		}
+
+		if (nodes.empty())
+		{
+			vector<uint> cpus;
+			for (uint cpu = 0; cpu < max(thread::hardware_concurrency(), 1u); cpu++)
+			{
+				cpus.push_back(cpu);
+			}
+			nodes.push_back(cpus);
+		}
+
+		return nodes;
+	}
 }
@@ -0,0 +1,171 @@
+#include "definitions.h"
+#include "memory-governor.hpp"
+#include "result-cache.hpp"
+#include "storage-adapter.hpp"
+#include "utility.hpp"
+
+#include "gtest/gtest.h"
+#include <atomic>
+
+using namespace std;
+
+namespace BPlusTree
+{
+	/**
+	 * @brief a cache that holds exactly its budget and whose benefit is set by the test
+	 */
+	class FakeCache : public GovernedCache
+	{
+		public:
+		atomic<number> budget  = 0;
+		atomic<number> counter = 0;
+
+		number memoryUsage() const final
+		{
+			return budget;
+		}
+
+		number benefit() const final
+		{
+			return counter;
+		}
+
+		void setBudget(number budget) final
+		{
+			this->budget = budget;
+		}
+	};
+
+	class MemoryGovernorTest : public ::testing::Test
+	{
+		public:
+		inline static const number BUDGET	  = 1000000;
+		inline static const number BLOCK_SIZE = 64;
+
+		protected:
+		MemoryGovernor governor = MemoryGovernor(BUDGET);
+	};
+
+	TEST_F(MemoryGovernorTest, EqualWithoutBenefit)
+	{
+		auto first	= make_shared<FakeCache>();
+		auto second = make_shared<FakeCache>();
+		governor.attach(first);
+		governor.attach(second);
+
+		EXPECT_EQ(BUDGET / 2, first->budget);
+		EXPECT_EQ(BUDGET / 2, second->budget);
+		EXPECT_EQ(BUDGET, governor.usage());
+	}
+
+	TEST_F(MemoryGovernorTest, BenefitGetsMemory)
+	{
+		auto useful	 = make_shared<FakeCache>();
+		auto useless = make_shared<FakeCache>();
+		governor.attach(useful);
+		governor.attach(useless);
+
+		for (auto i = 0; i < 5; i++)
+		{
+			useful->counter += 100;
+			governor.rebalance();
+		}
+
+		EXPECT_GT(useful->budget, BUDGET * 3 / 4);
+		// the minimal share is kept
+		EXPECT_GE(useless->budget, (number)(BUDGET * 0.2 / 2));
+		EXPECT_LE(useful->budget + useless->budget, BUDGET);
+	}
+
+	TEST_F(MemoryGovernorTest, ExpiredForgotten)
+	{
+		auto kept = make_shared<FakeCache>();
+		governor.attach(kept);
+		{
+			auto destroyed = make_shared<FakeCache>();
+			governor.attach(destroyed);
+			EXPECT_EQ(BUDGET / 2, kept->budget);
+		}
+		governor.rebalance();
+
+		EXPECT_EQ(BUDGET, kept->budget);
+	}
+
+	TEST_F(MemoryGovernorTest, ReserveShrinks)
+	{
+		auto cache = make_shared<FakeCache>();
+		governor.attach(cache);
+
+		governor.reserve(BUDGET / 4);
+		EXPECT_EQ(BUDGET * 3 / 4, cache->budget);
+		EXPECT_EQ(BUDGET, governor.usage());
+
+		governor.release(BUDGET / 4);
+		EXPECT_EQ(BUDGET, cache->budget);
+	}
+
+	TEST_F(MemoryGovernorTest, BackgroundRebalance)
+	{
+		auto useful	 = make_shared<FakeCache>();
+		auto useless = make_shared<FakeCache>();
+		governor.attach(useful);
+		governor.attach(useless);
+
+		governor.start(chrono::milliseconds(5));
+		EXPECT_THROW(governor.start(chrono::milliseconds(5)), Exception);
+
+		for (auto i = 0; i < 200 && useful->budget <= useless->budget; i++)
+		{
+			useful->counter += 100;
+			this_thread::sleep_for(chrono::milliseconds(5));
+		}
+
+		EXPECT_GT(useful->budget, useless->budget);
+	}
+
+	TEST_F(MemoryGovernorTest, RealCachesFitBudget)
+	{
+		auto storage = make_shared<InMemoryStorageAdapter>(BLOCK_SIZE);
+		vector<number> locations;
+		for (number i = 0; i < 1000; i++)
+		{
+			locations.push_back(storage->malloc());
+			storage->set(locations.back(), fromText(to_string(i), BLOCK_SIZE));
+		}
+
+		auto blocks	 = make_shared<CachedStorageAdapter>(storage, 1000);
+		auto results = make_shared<ResultCache>(BUDGET);
+
+		for (auto location : locations)
+		{
+			bytes block;
+			blocks->get(location, block);
+			results->insert({location, location, 0, ULLONG_MAX, ULLONG_MAX}, {block});
+		}
+
+		MemoryGovernor small(BUDGET / 100);
+		small.attach(blocks);
+		small.attach(results);
+
+		EXPECT_LE(blocks->memoryUsage() + results->memoryUsage(), BUDGET / 100);
+		EXPECT_LE(small.usage(), BUDGET / 100);
+		EXPECT_LT(0, blocks->cached());
+		EXPECT_LT(0, results->size());
+
+		// still correct after the shrink
+		for (auto location : locations)
+		{
+			bytes block;
+			blocks->get(location, block);
+			EXPECT_EQ(fromText(to_string(location - locations.front()), BLOCK_SIZE), block);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	srand(TEST_SEED);
+
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,165 @@
+#include "definitions.h"
+#include "query-executor.hpp"
+#include "utility.hpp"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace BPlusTree
+{
+	class QueryExecutorTest : public testing::TestWithParam<number>
+	{
+		public:
+		inline static const number BLOCK_SIZE = 64;
+
+		protected:
+		unique_ptr<Tree> tree;
+
+		QueryExecutorTest()
+		{
+			vector<pair<number, bytes>> data;
+			for (number i = 0; i < 500; i++)
+			{
+				data.push_back({i / 2, fromText(to_string(i), 100)});
+			}
+
+			tree = make_unique<Tree>(make_shared<InMemoryStorageAdapter>(BLOCK_SIZE), data);
+		}
+	};
+
+	TEST_P(QueryExecutorTest, Initialization)
+	{
+		ASSERT_NO_THROW({ QueryExecutor executor(GetParam()); });
+	}
+
+	TEST_P(QueryExecutorTest, NoThreads)
+	{
+		ASSERT_ANY_THROW(QueryExecutor(0));
+	}
+
+	TEST_P(QueryExecutorTest, EmptyBatch)
+	{
+		QueryExecutor executor(GetParam());
+
+		ASSERT_EQ(0, executor.run(*tree, {}).size());
+	}
+
+	TEST_P(QueryExecutorTest, ReusedAcrossBatches)
+	{
+		QueryExecutor executor(GetParam());
+
+		for (number i = 0; i < 20; i++)
+		{
+			auto results = executor.run(*tree, {{i, i + 10}, {i, i}});
+
+			vector<bytes> expected;
+			tree->search(i, i + 10, expected);
+			ASSERT_EQ(expected, results[0].response);
+		}
+	}
+
+	TEST_P(QueryExecutorTest, MixedBatch)
+	{
+		QueryExecutor executor(GetParam());
+
+		vector<Query> queries = {{0, 249}, {10, 10}, {300, 300}, {5, 100}, {240, 400}, {50, 40}};
+		for (number i = 0; i < 50; i++)
+		{
+			number key = rand() % 260;
+			queries.push_back({key, key});
+		}
+
+		auto results = executor.run(*tree, queries);
+
+		ASSERT_EQ(queries.size(), results.size());
+		for (uint i = 0; i < queries.size(); i++)
+		{
+			vector<bytes> expected;
+			tree->search(queries[i].start, queries[i].end, expected);
+
+			EXPECT_EQ(expected, results[i].response);
+			EXPECT_GT(results[i].latency.count(), 0);
+		}
+	}
+
+	TEST_P(QueryExecutorTest, Options)
+	{
+		QueryExecutor executor(GetParam());
+
+		SearchOptions options;
+		options.length = 3;
+
+		auto results = executor.run(*tree, {{0, 249}}, options);
+
+		ASSERT_EQ(500, results[0].response.size());
+		for (auto &response : results[0].response)
+		{
+			EXPECT_EQ(3, response.size());
+		}
+	}
+
+	TEST_P(QueryExecutorTest, Limit)
+	{
+		QueryExecutor executor(GetParam());
+
+		SearchOptions options;
+		options.limit = 7;
+
+		auto results = executor.run(*tree, {{0, 249}, {100, 100}}, options);
+
+		vector<bytes> expected;
+		tree->search(0, 249, expected);
+		expected.resize(7);
+
+		EXPECT_EQ(expected, results[0].response);
+		EXPECT_EQ(2, results[1].response.size());
+	}
+
+	TEST_P(QueryExecutorTest, PointsNotBlocked)
+	{
+		const number size = 50000;
+
+		vector<pair<number, bytes>> data;
+		for (number i = 0; i < size; i++)
+		{
+			data.push_back({i, fromText(to_string(i), 16)});
+		}
+		Tree big(make_shared<InMemoryStorageAdapter>(BLOCK_SIZE), data);
+
+		QueryExecutor executor(GetParam());
+
+		// the scan is queued first, the point lookups should not wait for it
+		vector<Query> queries = {{0, size - 1}};
+		for (number i = 0; i < 20; i++)
+		{
+			number key = rand() % size;
+			queries.push_back({key, key});
+		}
+
+		auto results = executor.run(big, queries);
+
+		ASSERT_EQ(size, results[0].response.size());
+		for (uint i = 1; i < queries.size(); i++)
+		{
+			ASSERT_EQ(1, results[i].response.size());
+			EXPECT_EQ(fromText(to_string(queries[i].start), 16), results[i].response[0]);
+			EXPECT_LT(results[i].latency, results[0].latency / 4);
+		}
+	}
+
+	string printTestName(testing::TestParamInfo<number> input)
+	{
+		return to_string(input.param);
+	}
+
+	INSTANTIATE_TEST_SUITE_P(QueryExecutorSuite, QueryExecutorTest, testing::Values(1, 2, 8), printTestName);
+}
+
+int main(int argc, char** argv)
+{
+	srand(TEST_SEED);
+
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
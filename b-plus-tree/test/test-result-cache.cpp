@@ -0,0 +1,127 @@
+#include "definitions.h"
+#include "result-cache.hpp"
+#include "utility.hpp"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace BPlusTree
+{
+	class ResultCacheTest : public ::testing::Test
+	{
+		public:
+		inline static const number PAYLOAD = 1000;
+		// fits roughly three entries
+		inline static const number BUDGET = 3 * PAYLOAD + 500;
+
+		protected:
+		ResultCache cache = ResultCache(BUDGET);
+
+		vector<bytes> result(number key)
+		{
+			return {fromText(to_string(key), PAYLOAD)};
+		}
+
+		ResultKey query(number key)
+		{
+			return {key, key, 0, ULLONG_MAX, ULLONG_MAX};
+		}
+
+		/**
+		 * @brief looks up the key as the tree would, inserting the result on miss
+		 */
+		bool access(number key)
+		{
+			vector<bytes> response;
+			if (cache.lookup(query(key), response))
+			{
+				EXPECT_EQ(result(key), response);
+				return true;
+			}
+			cache.insert(query(key), result(key));
+			return false;
+		}
+	};
+
+	TEST_F(ResultCacheTest, LookupWhatWasInserted)
+	{
+		EXPECT_FALSE(access(1));
+		EXPECT_TRUE(access(1));
+
+		EXPECT_EQ(1, cache.hits());
+		EXPECT_EQ(1, cache.misses());
+		EXPECT_LT(PAYLOAD, cache.size());
+	}
+
+	TEST_F(ResultCacheTest, KeyIncludesProjection)
+	{
+		cache.insert(query(1), result(1));
+
+		vector<bytes> response;
+		EXPECT_FALSE(cache.lookup({1, 1, 0, 10, ULLONG_MAX}, response));
+		EXPECT_FALSE(cache.lookup({1, 1, 0, ULLONG_MAX, 10}, response));
+		EXPECT_FALSE(cache.lookup({1, 2, 0, ULLONG_MAX, ULLONG_MAX}, response));
+		EXPECT_TRUE(response.empty());
+	}
+
+	TEST_F(ResultCacheTest, TooBig)
+	{
+		vector<bytes> response = {fromText("big", BUDGET + 1)};
+
+		EXPECT_FALSE(cache.insert(query(1), response));
+		EXPECT_EQ(0, cache.size());
+	}
+
+	TEST_F(ResultCacheTest, Budget)
+	{
+		for (number key = 0; key < 100; key++)
+		{
+			// popular enough to be admitted
+			access(key);
+			access(key);
+			access(key);
+			EXPECT_LE(cache.size(), BUDGET);
+		}
+	}
+
+	TEST_F(ResultCacheTest, AdmissionKeepsHotKeys)
+	{
+		// hot keys are accessed many times
+		for (auto i = 0; i < 10; i++)
+		{
+			for (number key = 0; key < 3; key++)
+			{
+				access(key);
+			}
+		}
+
+		// one-off keys do not push them out
+		for (number key = 100; key < 200; key++)
+		{
+			access(key);
+		}
+
+		for (number key = 0; key < 3; key++)
+		{
+			EXPECT_TRUE(access(key));
+		}
+	}
+
+	TEST_F(ResultCacheTest, Clear)
+	{
+		access(1);
+		cache.clear();
+
+		EXPECT_EQ(0, cache.size());
+		EXPECT_FALSE(access(1));
+	}
+}
+
+int main(int argc, char** argv)
+{
+	srand(TEST_SEED);
+
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -11,7 +11,8 @@ namespace BPlusTree
 	enum TestingStorageAdapterType
 	{
 		StorageAdapterTypeInMemory,
-		StorageAdapterTypeFileSystem
+		StorageAdapterTypeFileSystem,
+		StorageAdapterTypeCached
 	};
 
 	class StorageAdapterTest : public testing::TestWithParam<TestingStorageAdapterType>
@@ -34,6 +35,9 @@ namespace BPlusTree
 				case StorageAdapterTypeFileSystem:
 					adapter = make_unique<FileSystemStorageAdapter>(BLOCK_SIZE, FILE_NAME, true);
 					break;
+				case StorageAdapterTypeCached:
+					adapter = make_unique<CachedStorageAdapter>(make_shared<InMemoryStorageAdapter>(BLOCK_SIZE), 4);
+					break;
 				default:
 					throw Exception(boost::format("TestingStorageAdapterType %1% is not implemented") % type);
 			}
@@ -150,6 +154,52 @@ namespace BPlusTree
 		ASSERT_EQ(data, returned);
 	}
 
+	TEST_P(StorageAdapterTest, WillNeed)
+	{
+		auto data = fromText("hello", BLOCK_SIZE);
+
+		auto address = adapter->malloc();
+		adapter->set(address, data);
+
+		ASSERT_NO_THROW(adapter->willNeed({address, adapter->empty()}));
+
+		bytes returned;
+		adapter->get(address, returned);
+
+		ASSERT_EQ(data, returned);
+	}
+
+	TEST_P(StorageAdapterTest, Advance)
+	{
+		auto first	= adapter->malloc();
+		auto second = adapter->malloc();
+		auto third	= adapter->malloc();
+
+		EXPECT_EQ(first, adapter->advance(first, 0));
+		EXPECT_EQ(second, adapter->advance(first, 1));
+		EXPECT_EQ(third, adapter->advance(first, 2));
+		EXPECT_EQ(adapter->advance(second, 1), adapter->advance(first, 2));
+	}
+
+	TEST_P(StorageAdapterTest, Advise)
+	{
+		auto data = fromText("hello", BLOCK_SIZE);
+
+		auto address = adapter->malloc();
+		adapter->set(address, data);
+
+		for (auto i = 0; i < 2; i++)
+		{
+			ASSERT_NO_THROW(adapter->adviseSequential(address, 2));
+			ASSERT_NO_THROW(adapter->adviseRandom());
+		}
+
+		bytes returned;
+		adapter->get(address, returned);
+
+		ASSERT_EQ(data, returned);
+	}
+
 	TEST_P(StorageAdapterTest, Size)
 	{
 		// meta block only
@@ -165,6 +215,158 @@ namespace BPlusTree
 		EXPECT_EQ(3 * BLOCK_SIZE, adapter->size());
 	}
 
+	TEST_P(StorageAdapterTest, GetOnce)
+	{
+		auto data = fromText("hello", BLOCK_SIZE);
+
+		auto address = adapter->malloc();
+		adapter->set(address, data);
+		bytes returned;
+		adapter->getOnce(address, returned);
+
+		ASSERT_EQ(data, returned);
+	}
+
+	class CachedStorageAdapterTest : public ::testing::Test
+	{
+		public:
+		inline static const number BLOCK_SIZE = 32;
+		inline static const number CAPACITY	  = 8;
+
+		protected:
+		unique_ptr<CachedStorageAdapter> adapter;
+		vector<number> addresses;
+
+		CachedStorageAdapterTest()
+		{
+			adapter = make_unique<CachedStorageAdapter>(make_shared<InMemoryStorageAdapter>(BLOCK_SIZE), CAPACITY);
+			for (auto i = 0; i < 100; i++)
+			{
+				addresses.push_back(adapter->malloc());
+				adapter->set(addresses.back(), fromText(to_string(i), BLOCK_SIZE));
+			}
+		}
+
+		void read(number from, number to)
+		{
+			for (auto i = from; i < to; i++)
+			{
+				bytes returned;
+				adapter->get(addresses[i], returned);
+				ASSERT_EQ(fromText(to_string(i), BLOCK_SIZE), returned);
+			}
+		}
+	};
+
+	TEST_F(CachedStorageAdapterTest, HitsAndMisses)
+	{
+		read(0, 1);
+		read(0, 1);
+
+		EXPECT_EQ(1, adapter->misses());
+		EXPECT_EQ(1, adapter->hits());
+		EXPECT_EQ(1, adapter->cached());
+	}
+
+	TEST_F(CachedStorageAdapterTest, Capacity)
+	{
+		read(0, 50);
+
+		EXPECT_EQ(CAPACITY, adapter->cached());
+	}
+
+	TEST_F(CachedStorageAdapterTest, ScanResistance)
+	{
+		// the hot blocks are read, pushed out by other reads, and read again, so they become hot
+		read(0, 2);
+		read(10, 20);
+		read(0, 2);
+
+		// a wide scan reads every block once
+		read(20, 100);
+
+		auto hits = adapter->hits();
+		read(0, 2);
+		EXPECT_EQ(hits + 2, adapter->hits());
+	}
+
+	TEST_F(CachedStorageAdapterTest, GetOnceNotAdmitted)
+	{
+		bytes returned;
+		adapter->getOnce(addresses[0], returned);
+
+		EXPECT_EQ(fromText("0", BLOCK_SIZE), returned);
+		EXPECT_EQ(0, adapter->cached());
+	}
+
+	TEST_F(CachedStorageAdapterTest, WriteThrough)
+	{
+		read(0, 1);
+
+		auto data = fromText("updated", BLOCK_SIZE);
+		adapter->set(addresses[0], data);
+
+		bytes returned;
+		adapter->get(addresses[0], returned);
+		EXPECT_EQ(data, returned);
+		EXPECT_EQ(1, adapter->hits());
+	}
+
+	TEST_F(CachedStorageAdapterTest, Warm)
+	{
+		adapter->warm({addresses[0], addresses[1]});
+		EXPECT_EQ(2, adapter->cached());
+
+		read(0, 2);
+		EXPECT_EQ(2, adapter->hits());
+		EXPECT_EQ(0, adapter->misses());
+
+		// warmed blocks are hot, a scan does not evict them
+		read(10, 100);
+		auto hits = adapter->hits();
+		read(0, 2);
+		EXPECT_EQ(hits + 2, adapter->hits());
+	}
+
+	TEST_F(CachedStorageAdapterTest, HotSet)
+	{
+		adapter->warm({addresses[0]});
+		read(5, 6);
+
+		EXPECT_EQ(vector<number>({addresses[0], addresses[5]}), adapter->hotSet());
+	}
+
+	TEST_F(CachedStorageAdapterTest, SaveLoadWarmSet)
+	{
+		const auto FILE_NAME = "warm.bin";
+
+		EXPECT_EQ(0, CachedStorageAdapter::loadWarmSet(FILE_NAME).size());
+
+		read(0, 5);
+		adapter->saveWarmSet(FILE_NAME);
+
+		EXPECT_EQ(adapter->hotSet(), CachedStorageAdapter::loadWarmSet(FILE_NAME));
+
+		remove(FILE_NAME);
+	}
+
+	TEST_F(CachedStorageAdapterTest, RecordWarmSet)
+	{
+		const auto FILE_NAME = "warm.bin";
+
+		read(0, 3);
+		adapter->recordWarmSet(FILE_NAME, chrono::milliseconds(1));
+		ASSERT_ANY_THROW(adapter->recordWarmSet(FILE_NAME, chrono::milliseconds(1)));
+
+		auto expected = adapter->hotSet();
+		// the last save happens on destruction
+		adapter.reset();
+
+		EXPECT_EQ(expected, CachedStorageAdapter::loadWarmSet(FILE_NAME));
+
+		remove(FILE_NAME);
+	}
+
 	string printTestName(testing::TestParamInfo<TestingStorageAdapterType> input)
 	{
 		switch (input.param)
@@ -173,12 +375,14 @@ namespace BPlusTree
 				return "InMemory";
 			case StorageAdapterTypeFileSystem:
 				return "FileSystem";
+			case StorageAdapterTypeCached:
+				return "Cached";
 			default:
 				throw Exception(boost::format("TestingStorageAdapterType %1% is not implemented") % input.param);
 		}
 	}
 
-	INSTANTIATE_TEST_SUITE_P(StorageAdapterSuite, StorageAdapterTest, testing::Values(StorageAdapterTypeInMemory, StorageAdapterTypeFileSystem), printTestName);
+	INSTANTIATE_TEST_SUITE_P(StorageAdapterSuite, StorageAdapterTest, testing::Values(StorageAdapterTypeInMemory, StorageAdapterTypeFileSystem, StorageAdapterTypeCached), printTestName);
 }
 
 int main(int argc, char** argv)
@@ -0,0 +1,68 @@
+#include "definitions.h"
+#include "thread-pool.hpp"
+
+#include "gtest/gtest.h"
+#include <atomic>
+#include <future>
+
+using namespace std;
+
+namespace BPlusTree
+{
+	class ThreadPoolTest : public ::testing::Test
+	{
+	};
+
+	TEST_F(ThreadPoolTest, Initialization)
+	{
+		ASSERT_NO_THROW(ThreadPool(2, 10));
+	}
+
+	TEST_F(ThreadPoolTest, NoThreads)
+	{
+		ASSERT_ANY_THROW(ThreadPool(0, 10));
+	}
+
+	TEST_F(ThreadPoolTest, RunsAllTasks)
+	{
+		const auto COUNT = 100;
+
+		atomic<int> counter = 0;
+		{
+			ThreadPool pool(4, COUNT);
+			for (auto i = 0; i < COUNT; i++)
+			{
+				ASSERT_TRUE(pool.submit([&counter]() { counter++; }));
+			}
+		}
+
+		ASSERT_EQ(COUNT, counter);
+	}
+
+	TEST_F(ThreadPoolTest, RejectsOverCapacity)
+	{
+		const auto CAPACITY = 3;
+
+		ThreadPool pool(1, CAPACITY);
+
+		promise<void> release;
+		auto released = release.get_future().share();
+		for (auto i = 0; i < CAPACITY; i++)
+		{
+			ASSERT_TRUE(pool.submit([released]() { released.wait(); }));
+		}
+
+		EXPECT_EQ(CAPACITY, pool.inFlight());
+		EXPECT_FALSE(pool.submit([]() {}));
+
+		release.set_value();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	srand(TEST_SEED);
+
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -3,7 +3,9 @@
 #include "utility.hpp"
 
 #include "gtest/gtest.h"
+#include <atomic>
 #include <boost/algorithm/string.hpp>
+#include <thread>
 
 using namespace std;
 
@@ -149,6 +151,60 @@ namespace BPlusTree
 		EXPECT_EQ(expected, returned);
 	}
 
+	TEST_P(TreeTestBig, ConcurrentReaders)
+	{
+		const auto THREADS = 8;
+		const auto QUERIES = 200;
+
+		vector<pair<number, bytes>> data;
+		for (number i = 0; i < COUNT; i++)
+		{
+			data.push_back({rand() % (COUNT / 3),
+							random(BLOCK_SIZE * 3)});
+		}
+
+		tree = make_unique<Tree>(move(storage), data);
+
+		disaster();
+
+		// queries and answers are prepared upfront, so that the threads only run the searches
+		vector<tuple<number, number, vector<bytes>>> queries;
+		for (auto i = 0; i < QUERIES; i++)
+		{
+			number start = rand() % (COUNT / 3);
+			number end	 = i % 2 == 0 ? start : start + rand() % 10;
+			queries.push_back({start, end, getExpected(data, start, end)});
+		}
+
+		atomic<int> mismatches = 0;
+		vector<thread> readers;
+		for (auto t = 0; t < THREADS; t++)
+		{
+			readers.push_back(thread([this, t, &queries, &mismatches]() {
+				const Tree &reader = *tree;
+				for (uint i = 0; i < queries.size(); i++)
+				{
+					auto &[start, end, expected] = queries[(i + t * 17) % queries.size()];
+
+					vector<bytes> returned;
+					reader.search(start, end, returned);
+					sort(returned.begin(), returned.end());
+
+					if (returned != expected)
+					{
+						mismatches++;
+					}
+				}
+			}));
+		}
+		for (auto &reader : readers)
+		{
+			reader.join();
+		}
+
+		ASSERT_EQ(0, mismatches);
+	}
+
 	string printTestName(testing::TestParamInfo<tuple<number, number, TestingStorageAdapterType>> input)
 	{
 		auto [blockSize, count, type] = input.param;
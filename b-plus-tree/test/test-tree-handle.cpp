@@ -0,0 +1,148 @@
+#include "definitions.h"
+#include "tree-handle.hpp"
+#include "utility.hpp"
+
+#include "gtest/gtest.h"
+#include <atomic>
+#include <thread>
+
+using namespace std;
+
+namespace BPlusTree
+{
+	class TreeHandleTest : public ::testing::Test
+	{
+		public:
+		inline static const number BLOCK_SIZE = 128;
+
+		protected:
+		/**
+		 * @brief builds an in-memory tree where every key in [0, count) maps to the given text
+		 */
+		shared_ptr<const Tree> build(string text, number count = 20)
+		{
+			vector<pair<number, bytes>> data;
+			for (number i = 0; i < count; i++)
+			{
+				data.push_back({i, fromText(text, 16)});
+			}
+
+			return make_shared<Tree>(make_shared<InMemoryStorageAdapter>(BLOCK_SIZE), data);
+		}
+
+		string read(const shared_ptr<const Tree> &tree, number key)
+		{
+			vector<bytes> returned;
+			tree->search(key, returned);
+
+			return returned.size() == 1 ? toText(returned[0], 16) : "";
+		}
+	};
+
+	TEST_F(TreeHandleTest, Empty)
+	{
+		TreeHandle handle;
+
+		ASSERT_EQ(nullptr, handle.acquire());
+		ASSERT_EQ(0, handle.epoch());
+
+		number epoch = 1;
+		ASSERT_EQ(nullptr, handle.acquire(epoch));
+		ASSERT_EQ(0, epoch);
+	}
+
+	TEST_F(TreeHandleTest, Publish)
+	{
+		TreeHandle handle(build("first"));
+		ASSERT_EQ("first", read(handle.acquire(), 5));
+
+		auto previous = handle.publish(build("second"));
+
+		EXPECT_EQ("first", read(previous, 5));
+		EXPECT_EQ("second", read(handle.acquire(), 5));
+		EXPECT_EQ(1, handle.epoch());
+	}
+
+	TEST_F(TreeHandleTest, ReaderKeepsOldTree)
+	{
+		TreeHandle handle(build("first"));
+
+		auto reader = handle.acquire();
+		weak_ptr<const Tree> old(reader);
+
+		handle.publish(build("second"));
+
+		// the reader still holds the old tree
+		ASSERT_FALSE(old.expired());
+		ASSERT_EQ("first", read(reader, 5));
+
+		reader.reset();
+
+		// reclaimed once released
+		ASSERT_TRUE(old.expired());
+	}
+
+	TEST_F(TreeHandleTest, AsyncSearchOnAcquired)
+	{
+		TreeHandle handle(build("first"));
+
+		// the readers get const trees, the asynchronous search is available on them
+		auto found = handle.acquire()->searchAsync(5);
+		handle.publish(build("second"));
+
+		auto returned = found.get();
+		ASSERT_EQ(1, returned.size());
+		EXPECT_EQ("first", toText(returned[0], 16));
+	}
+
+	TEST_F(TreeHandleTest, ConcurrentSwaps)
+	{
+		const auto READERS = 4;
+		const auto SWAPS   = 50;
+
+		TreeHandle handle(build("0"));
+
+		atomic<bool> done	   = false;
+		atomic<int> mismatches = 0;
+		vector<thread> readers;
+		for (auto t = 0; t < READERS; t++)
+		{
+			readers.push_back(thread([this, &handle, &done, &mismatches]() {
+				while (!done)
+				{
+					// every key of one tree has the same text (its epoch), whichever tree is current
+					number epoch;
+					auto tree  = handle.acquire(epoch);
+					auto first = read(tree, 0);
+					if (first != to_string(epoch) || read(tree, 19) != first)
+					{
+						mismatches++;
+					}
+				}
+			}));
+		}
+
+		for (auto i = 1; i <= SWAPS; i++)
+		{
+			handle.publish(build(to_string(i)));
+		}
+		done = true;
+
+		for (auto &reader : readers)
+		{
+			reader.join();
+		}
+
+		ASSERT_EQ(0, mismatches);
+		ASSERT_EQ(to_string(SWAPS), read(handle.acquire(), 0));
+		ASSERT_EQ(SWAPS, handle.epoch());
+	}
+}
+
+int main(int argc, char** argv)
+{
+	srand(TEST_SEED);
+
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
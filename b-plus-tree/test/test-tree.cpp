@@ -4,6 +4,8 @@
 
 #include "gtest/gtest.h"
 #include <boost/algorithm/string.hpp>
+#include <thread>
+#include <unistd.h>
 
 using namespace std;
 
@@ -55,6 +57,69 @@ namespace BPlusTree
 		}
 	};
 
+	/**
+	 * @brief in-memory storage that records the advised readahead windows and the reads made after the first one
+	 */
+	class AdviceRecordingStorageAdapter : public AbsStorageAdapter
+	{
+		private:
+		shared_ptr<AbsStorageAdapter> storage;
+
+		public:
+		mutable vector<pair<number, number>> windows;
+		mutable vector<number> reads;
+
+		AdviceRecordingStorageAdapter(number blockSize) :
+			AbsStorageAdapter(blockSize),
+			storage(make_shared<InMemoryStorageAdapter>(blockSize))
+		{
+		}
+
+		void get(number location, bytes &response) const final
+		{
+			if (!windows.empty())
+			{
+				reads.push_back(location);
+			}
+			storage->get(location, response);
+		}
+
+		void set(number location, const bytes &data) final
+		{
+			storage->set(location, data);
+		}
+
+		number malloc() final
+		{
+			return storage->malloc();
+		}
+
+		number empty() const final
+		{
+			return storage->empty();
+		}
+
+		number meta() const final
+		{
+			return storage->meta();
+		}
+
+		number size() const final
+		{
+			return storage->size();
+		}
+
+		number advance(number location, number count) const final
+		{
+			return storage->advance(location, count);
+		}
+
+		void adviseSequential(number location, number count) const final
+		{
+			windows.push_back({location, advance(location, count)});
+		}
+	};
+
 	bytes generateDataBytes(string word, int size)
 	{
 		stringstream ss;
@@ -140,6 +205,57 @@ namespace BPlusTree
 		}
 	}
 
+	TEST_P(TreeTest, DataLayerForward)
+	{
+		// payloads span several storage blocks
+		populateTree(5, 15, 3 * BLOCK_SIZE);
+
+		auto current = tree->leftmostDataBlock;
+		while (true)
+		{
+			auto [key, next] = tree->readDataBlockHeader(tree->checkType(current).second);
+			if (next == storage->empty())
+			{
+				break;
+			}
+			ASSERT_LT(current, next);
+			current = next;
+		}
+	}
+
+	TEST_P(TreeTest, ReadDataBlockProjection)
+	{
+		const auto size = BLOCK_SIZE * 4;
+
+		auto data = populateTree(5, 7, size);
+
+		auto [type, read] = tree->checkType(tree->leftmostDataBlock);
+		ASSERT_EQ(DataBlock, type);
+
+		vector<pair<number, number>> windows = {{0, 10}, {0, size}, {BLOCK_SIZE, BLOCK_SIZE * 2}, {size - 5, 100}, {size, 10}, {size + 10, 10}};
+		for (auto [offset, length] : windows)
+		{
+			auto [payload, key, next] = tree->readDataBlock(read, offset, length);
+
+			auto from = min(offset, size);
+			auto to	  = min(offset + length, size);
+			bytes expected(data[0].second.begin() + from, data[0].second.begin() + to);
+
+			EXPECT_EQ(expected, payload);
+			EXPECT_EQ(5, key);
+		}
+
+		// corrupt the continuation block; the projection of the head must not touch it
+		auto nextBlock = deconstructNumbers(deconstruct(read, {2 * sizeof(number)})[0])[1];
+		bytes continuation;
+		storage->get(nextBlock, continuation);
+		continuation[0] = 0xff;
+		storage->set(nextBlock, continuation);
+
+		ASSERT_NO_THROW(tree->readDataBlock(read, 0, 10));
+		ASSERT_THROW_CONTAINS(tree->readDataBlock(read), "non-data block");
+	}
+
 	TEST_P(TreeTest, CreateNodeBlockTooBig)
 	{
 		tree = make_unique<Tree>(storage);
@@ -281,57 +397,1418 @@ namespace BPlusTree
 		ASSERT_EQ(expected, returned);
 	}
 
-	TEST_P(TreeTest, BasicSearchRangeDuplicates)
+	TEST_P(TreeTest, BatchSearch)
 	{
-		const auto start	  = 8uLL;
-		const auto end		  = 11uLL;
 		const auto duplicates = 3;
 
-		auto data = populateTree(5, 15, 100, duplicates);
+		populateTree(5, 40, BLOCK_SIZE * 2, duplicates);
+
+		vector<number> keys;
+		for (auto i = 0; i < 100; i++)
+		{
+			keys.push_back(rand() % 50);
+		}
+
+		vector<vector<bytes>> returned;
+		tree->search(keys, returned);
+
+		ASSERT_EQ(keys.size(), returned.size());
+		for (uint i = 0; i < keys.size(); i++)
+		{
+			vector<bytes> expected;
+			tree->search(keys[i], expected);
+
+			EXPECT_EQ(keys[i] >= 5 && keys[i] <= 40 ? duplicates : 0, returned[i].size());
+			EXPECT_EQ(expected, returned[i]);
+		}
+	}
+
+	TEST_P(TreeTest, MultiRangeSearch)
+	{
+		const auto duplicates = 3;
+
+		populateTree(5, 200, BLOCK_SIZE * 2, duplicates);
+
+		// sorted and disjoint, some adjacent, some beyond the keys
+		vector<pair<number, number>> ranges;
+		for (number start = 0; start < 250; start += 1 + rand() % 20)
+		{
+			auto end = start + rand() % 5;
+			ranges.push_back({start, end});
+			start = end;
+		}
+		// shuffled and overlapping
+		for (auto i = 0; i < 20; i++)
+		{
+			auto start = rand() % 250;
+			ranges.push_back({start, start + rand() % 30});
+		}
+		ranges.push_back({10, 5});
+
+		for (auto cache : {true, false})
+		{
+			SearchOptions options;
+			options.cache = cache;
+
+			vector<vector<bytes>> returned;
+			tree->search(ranges, returned, options);
+
+			ASSERT_EQ(ranges.size(), returned.size());
+			for (uint i = 0; i < ranges.size(); i++)
+			{
+				vector<bytes> expected;
+				tree->search(ranges[i].first, ranges[i].second, expected);
+
+				EXPECT_EQ(expected, returned[i]);
+			}
+		}
+	}
+
+	TEST_P(TreeTest, MultiRangeSearchProjection)
+	{
+		populateTree(5, 40, BLOCK_SIZE * 2);
+
+		SearchOptions options;
+		options.offset = BLOCK_SIZE / 2;
+		options.length = BLOCK_SIZE;
+
+		vector<pair<number, number>> ranges = {{5, 7}, {8, 8}, {20, 30}};
+		vector<vector<bytes>> returned;
+		tree->search(ranges, returned, options);
+
+		for (uint i = 0; i < ranges.size(); i++)
+		{
+			vector<bytes> expected;
+			tree->search(ranges[i].first, ranges[i].second, expected, options);
+
+			EXPECT_EQ(ranges[i].second - ranges[i].first + 1, returned[i].size());
+			EXPECT_EQ(expected, returned[i]);
+		}
+	}
+
+	TEST_P(TreeTest, ParallelSearch)
+	{
+		populateTree(5, 60, 100, 3);
+
+		vector<pair<number, number>> ranges = {{5, 60}, {0, 100}, {10, 12}, {20, 20}, {61, 100}, {30, 20}, {7, 51}};
+		for (auto [start, end] : ranges)
+		{
+			vector<bytes> expected;
+			tree->search(start, end, expected);
+
+			for (auto threads : {0, 1, 2, 3, 8})
+			{
+				vector<bytes> returned;
+				tree->searchParallel(start, end, returned, threads);
+
+				EXPECT_EQ(expected, returned) << "range [" << start << ", " << end << "] on " << threads << " threads";
+			}
+		}
+	}
+
+	TEST_P(TreeTest, Rank)
+	{
+		auto data = populateTree(5, 300, 10, 2);
+
+		auto reloaded = make_unique<Tree>(storage);
+		ASSERT_EQ(data.size(), reloaded->records);
+		for (number key = 0; key < 310; key += 7)
+		{
+			auto expected = count_if(data.begin(), data.end(), [key](const pair<number, bytes> &record) { return record.first < key; });
+			EXPECT_EQ(expected, reloaded->rank(key));
+			if ((number)expected < data.size())
+			{
+				auto [found, nextBucket] = reloaded->readDataBlockHeader(reloaded->checkType(reloaded->recordAt(expected)).second);
+				EXPECT_EQ(data[expected].first, found);
+			}
+		}
+	}
+
+	TEST_P(TreeTest, Sample)
+	{
+		const auto start = 100uLL;
+		const auto end	 = 300uLL;
+		const auto k	 = 20;
+
+		auto data = populateTree(5, 500, 10, 2);
+
+		map<bytes, number> keys;
+		for (auto &[key, payload] : data)
+		{
+			keys[payload] = key;
+		}
 
 		vector<bytes> returned;
-		tree->search(start, end, returned);
+		tree->sample(start, end, k, returned);
+
+		ASSERT_EQ(k, returned.size());
+		number previous = 0;
+		for (auto &payload : returned)
+		{
+			ASSERT_NE(keys.end(), keys.find(payload));
+			auto key = keys[payload];
+			EXPECT_GE(key, start);
+			EXPECT_LE(key, end);
+			EXPECT_LE(previous, key);
+			previous = key;
+		}
+	}
+
+	TEST_P(TreeTest, SampleUniform)
+	{
+		const auto start  = 100uLL;
+		const auto end	  = 119uLL;
+		const auto rounds = 2000;
 
+		populateTree(5, 500, 10, 2);
+
+		map<bytes, number> hits;
+		for (auto i = 0; i < rounds; i++)
+		{
+			vector<bytes> returned;
+			tree->sample(start, end, 1, returned);
+			ASSERT_EQ(1, returned.size());
+			hits[returned[0]]++;
+		}
+
+		// each key is expected rounds / 20 times
+		ASSERT_EQ(end - start + 1, hits.size());
+		for (auto &[payload, count] : hits)
+		{
+			EXPECT_GT(count, rounds / 20 / 2);
+			EXPECT_LT(count, rounds / 20 * 2);
+		}
+	}
+
+	TEST_P(TreeTest, SampleSmallRange)
+	{
+		populateTree(5, 15, 10, 3);
+
+		vector<bytes> returned, expected;
+		tree->sample(7, 8, 10, returned);
+		tree->search(7, 8, expected);
+		EXPECT_EQ(expected, returned);
+
+		returned.clear();
+		tree->sample(20, 30, 10, returned);
+		EXPECT_EQ(0, returned.size());
+	}
+
+	TEST_P(TreeTest, SampleLimit)
+	{
+		populateTree(5, 500, 10, 2);
+
+		SearchOptions options;
+		options.limit = 5;
+
+		// the limit caps the sample of a large range as it does that of a small one
+		vector<bytes> returned;
+		tree->sample(100, 300, 20, returned, options);
+		EXPECT_EQ(5, returned.size());
+
+		returned.clear();
+		tree->sample(100, 104, 20, returned, options);
+		EXPECT_EQ(5, returned.size());
+	}
+
+	TEST_P(TreeTest, SampleFiltered)
+	{
+		auto data = populateTree(5, 500, 10, 2);
+
+		map<bytes, number> keys;
+		for (auto &[key, payload] : data)
+		{
+			keys[payload] = key;
+		}
+
+		SearchOptions options;
+		options.predicate = [](number key, const uchar *data, number size) { return key % 10 == 0; };
+
+		// only one record in ten matches, the sample is still full
+		vector<bytes> returned;
+		tree->sample(100, 300, 20, returned, options);
+		ASSERT_EQ(20, returned.size());
+		for (auto &payload : returned)
+		{
+			EXPECT_EQ(0, keys[payload] % 10);
+		}
+
+		// fewer matching records than k, all of them are returned
+		returned.clear();
+		tree->sample(100, 300, 100, returned, options);
 		vector<bytes> expected;
-		auto i = data.begin();
-		while (i != data.end())
+		tree->search(100, 300, expected, options);
+		EXPECT_EQ(expected, returned);
+	}
+
+	TEST_P(TreeTest, EstimateCount)
+	{
+		auto data = populateTree(5, 1000, 10, 2);
+
+		// count the reads to make sure no Data Block is touched
+		auto reads	  = make_shared<CachedStorageAdapter>(storage, 0);
+		auto reloaded = make_unique<Tree>(reads);
+		auto b		  = (BLOCK_SIZE - sizeof(number)) / (2 * sizeof(number));
+
+		number height = 0;
+		for (number span = 1; span < data.size(); span *= b)
 		{
-			i = find_if(
-				i,
-				data.end(),
-				[](const pair<number, bytes>& val) {
-					return val.first >= start && val.first <= end;
-				});
-			if (i != data.end())
+			height++;
+		}
+
+		for (auto [start, end] : vector<pair<number, number>>{{0, 2000}, {100, 200}, {500, 500}, {999, 5000}, {10, 5}})
+		{
+			auto exact = (number)count_if(data.begin(), data.end(), [start = start, end = end](const pair<number, bytes> &record) { return record.first >= start && record.first <= end; });
+
+			auto misses = reads->misses();
+			EXPECT_EQ(exact, reloaded->estimateCount(start, end));
+			EXPECT_LE(reads->misses() - misses, 2 * height);
+
+			for (number levels = 1; levels < height; levels++)
 			{
-				auto element = (*i).second;
-				expected.push_back(element);
-				i++;
+				number error = 1;
+				for (auto i = levels; i < height; i++)
+				{
+					error *= b;
+				}
+
+				auto estimate = reloaded->estimateCount(start, end, levels);
+				EXPECT_LE(max(estimate, exact) - min(estimate, exact), error);
 			}
 		}
-		ASSERT_EQ(expected, returned);
 	}
 
-	TEST_P(TreeTest, BasicSearchAll)
+	TEST_P(TreeTest, Stats)
 	{
-		const auto start = 5uLL;
-		const auto end	 = 15uLL;
+		// a heavy key in the middle
+		auto data  = generateDataPoints(5, 1000, 10, 2);
+		auto heavy = generateDataPoints(500, 500, 10, 300);
+		data.insert(data.end(), heavy.begin(), heavy.end());
+		tree = make_unique<Tree>(storage, data);
 
-		auto data = populateTree();
+		auto stats = tree->stats();
+		EXPECT_EQ(data.size(), stats.records);
+		EXPECT_EQ(996, stats.distinct);
+		EXPECT_EQ(5, stats.minKey);
+		EXPECT_EQ(1000, stats.maxKey);
+		EXPECT_EQ(302, stats.maxDuplicates);
+
+		ASSERT_LE(stats.histogram.size(), 64);
+		EXPECT_EQ(1000, stats.histogram.back().first);
+		number total = 0;
+		for (uint i = 0; i < stats.histogram.size(); i++)
+		{
+			auto [key, count] = stats.histogram[i];
+			total += count;
+
+			auto previous = i == 0 ? 0 : stats.histogram[i - 1].first;
+			EXPECT_LT(previous, key);
+			auto exact = count_if(data.begin(), data.end(), [previous, key = key](const pair<number, bytes> &record) { return record.first > previous && record.first <= key; });
+			EXPECT_EQ(exact, count);
+		}
+		EXPECT_EQ(data.size(), total);
+
+		// persisted with the tree
+		auto reloaded = make_unique<Tree>(storage);
+		EXPECT_EQ(stats, reloaded->stats());
 
+		// the statistics block is not a part of the tree
 		vector<bytes> returned;
-		tree->search(start, end, returned);
+		tree->search(0, 0, returned);
+		EXPECT_EQ(0, returned.size());
+	}
+
+	TEST_P(TreeTest, StatsMissing)
+	{
+		populateTree();
+
+		// the meta block of a tree stored without the statistics has only the root
+		bytes meta;
+		storage->get(storage->meta(), meta);
+		fill(meta.begin() + sizeof(number), meta.end(), 0);
+		storage->set(storage->meta(), meta);
+
+		auto reloaded = make_unique<Tree>(storage);
+		EXPECT_EQ(TreeStats(), reloaded->stats());
+
+		vector<bytes> returned;
+		reloaded->search(5, 15, returned);
+		EXPECT_EQ(11, returned.size());
+	}
+
+	TEST_P(TreeTest, SearchPages)
+	{
+		const auto start = 10uLL;
+		const auto end	 = 60uLL;
+
+		populateTree(5, 100, BLOCK_SIZE * 2, 3);
 
 		vector<bytes> expected;
-		expected.resize(data.size());
+		tree->search(start, end, expected);
 
-		transform(
-			data.begin(),
-			data.end(),
-			expected.begin(),
-			[](pair<number, bytes> val) { return val.second; });
+		for (auto count : {1uLL, 4uLL, 7uLL, 1000uLL})
+		{
+			vector<bytes> returned;
+			auto token = tree->search(start, end, count, returned);
+			auto pages = 1;
+			while (!token.empty())
+			{
+				vector<bytes> page;
+				token = tree->resume(token, count, page);
+				EXPECT_LE(page.size(), count);
+				returned.insert(returned.end(), page.begin(), page.end());
+				pages++;
+			}
 
-		ASSERT_EQ(expected, returned);
+			EXPECT_EQ(expected, returned);
+			EXPECT_EQ((expected.size() + count - 1) / count, pages);
+		}
+	}
+
+	TEST_P(TreeTest, SearchPagesStaleToken)
+	{
+		auto data = generateDataPoints(5, 100, BLOCK_SIZE * 2, 3);
+		tree	  = make_unique<Tree>(storage, data);
+
+		vector<bytes> first;
+		auto token = tree->search(10, 60, 5, first);
+
+		// the same data rebuilt in the same storage (so with the same secret) at different addresses
+		auto rebuilt = make_unique<Tree>(storage, data);
+
+		vector<bytes> expected, returned;
+		tree->resume(token, 1000, expected);
+		rebuilt->resume(token, 1000, returned);
+
+		EXPECT_EQ(expected, returned);
+		EXPECT_EQ(3 * 51 - 5, returned.size());
+
+		// another storage has another secret
+		auto otherStorage = make_shared<InMemoryStorageAdapter>(BLOCK_SIZE);
+		auto other		  = make_unique<Tree>(otherStorage, data);
+		ASSERT_THROW_CONTAINS(other->resume(token, 1000, returned), "malformed");
+	}
+
+	TEST_P(TreeTest, SearchPagesMalformedToken)
+	{
+		populateTree();
+
+		vector<bytes> returned;
+		auto token = tree->search(10, 60, 5, returned);
+		ASSERT_EQ(6 * sizeof(number), token.size());
+
+		ASSERT_THROW_CONTAINS(tree->resume(bytes(10), 1, returned), "malformed");
+		ASSERT_THROW_CONTAINS(tree->resume(bytes(token.begin(), token.end() - 1), 1, returned), "malformed");
+		ASSERT_THROW_CONTAINS(tree->resume(concatNumbers(6, 1uLL, 2uLL, 3uLL, 4uLL, 5uLL, 6uLL), 1, returned), "malformed");
+
+		// the end (or the address) cannot be moved without the secret
+		auto numbers = deconstructNumbers(token);
+		for (auto word : {1, 3})
+		{
+			auto forged = numbers;
+			forged[word] += BLOCK_SIZE;
+			ASSERT_THROW_CONTAINS(tree->resume(concatNumbers(6, forged[0], forged[1], forged[2], forged[3], forged[4], forged[5]), 1, returned), "malformed");
+		}
+	}
+
+	TEST_P(TreeTest, SearchPagesLegacySecret)
+	{
+		populateTree(5, 100);
+
+		// a storage written before the secret was stored has zeros in its place
+		bytes meta;
+		storage->get(storage->meta(), meta);
+		auto words	= deconstructNumbers(bytes(meta.begin(), meta.begin() + 4 * sizeof(number)));
+		auto zeroed = concatNumbers(4, words[0], words[1], 0uLL, 0uLL);
+		zeroed.resize(BLOCK_SIZE);
+		storage->set(storage->meta(), zeroed);
+
+		auto reopened = make_unique<Tree>(storage);
+
+		vector<bytes> returned;
+		auto numbers = deconstructNumbers(reopened->search(10, 60, 5, returned));
+
+		// a token signed with the zero key is not accepted
+		numbers[3]	= 100;
+		numbers[5]	= sipHash({0, 0}, {numbers[0], numbers[1], numbers[2], numbers[3], numbers[4]});
+		auto forged = concatNumbers(6, numbers[0], numbers[1], numbers[2], numbers[3], numbers[4], numbers[5]);
+		ASSERT_THROW_CONTAINS(reopened->resume(forged, 1000, returned), "malformed");
+
+		// the generated secret is persisted, the tokens stay valid for the trees opened later
+		returned.clear();
+		auto token = reopened->search(10, 60, 5, returned);
+		vector<bytes> expected, resumed;
+		reopened->resume(token, 1000, expected);
+		make_unique<Tree>(storage)->resume(token, 1000, resumed);
+		EXPECT_EQ(expected, resumed);
+		EXPECT_EQ(51 - 5, resumed.size());
+	}
+
+	TEST_P(TreeTest, SearchCancelled)
+	{
+		populateTree(5, 100, BLOCK_SIZE * 2);
+
+		SearchOptions options;
+		options.control = make_shared<QueryControl>();
+
+		// cancelled by the consumer, as if by another thread
+		vector<number> keys;
+		tree->search(
+			10,
+			90,
+			[&keys, &options](number key, const uchar *data, number size, bool last) {
+				if (last)
+				{
+					keys.push_back(key);
+				}
+				if (keys.size() == 5)
+				{
+					options.control->cancel();
+				}
+			},
+			options);
+
+		EXPECT_EQ(vector<number>({10, 11, 12, 13, 14}), keys);
+		EXPECT_TRUE(options.control->truncated());
+
+		// the following searches with the same control stop right away
+		vector<bytes> returned;
+		tree->search(10, 90, returned, options);
+		EXPECT_EQ(0, returned.size());
+
+		vector<vector<bytes>> batch;
+		tree->search(vector<number>{10, 20, 30}, batch, options);
+		EXPECT_EQ(3, batch.size());
+		EXPECT_EQ(0, batch[0].size());
+	}
+
+	TEST_P(TreeTest, SearchCancelledMidPayload)
+	{
+		populateTree(5, 20, BLOCK_SIZE * 10);
+
+		SearchOptions options;
+		options.control = make_shared<QueryControl>();
+
+		// cancelled after the first slice of a payload spanning many storage blocks
+		vector<pair<number, bool>> slices;
+		tree->search(
+			10,
+			15,
+			[&slices, &options](number key, const uchar *data, number size, bool last) {
+				slices.push_back({key, last});
+				options.control->cancel();
+			},
+			options);
+
+		ASSERT_EQ(2, slices.size());
+		EXPECT_EQ(make_pair(10uLL, false), slices[0]);
+		EXPECT_EQ(make_pair(10uLL, true), slices[1]);
+		EXPECT_TRUE(options.control->truncated());
+	}
+
+	TEST_P(TreeTest, SearchDeadline)
+	{
+		populateTree(5, 100, BLOCK_SIZE * 2);
+		tree->setResultCache(make_shared<ResultCache>(1uLL << 20));
+
+		SearchOptions options;
+		options.control = make_shared<QueryControl>(chrono::steady_clock::now() - chrono::seconds(1));
+
+		vector<bytes> returned;
+		tree->search(10, 90, returned, options);
+		EXPECT_EQ(0, returned.size());
+		EXPECT_TRUE(options.control->truncated());
+
+		// the partial result is not cached
+		options.control = make_shared<QueryControl>(chrono::steady_clock::now() + chrono::hours(1));
+		tree->search(10, 90, returned, options);
+		EXPECT_EQ(81, returned.size());
+		EXPECT_FALSE(options.control->truncated());
+	}
+
+	TEST_P(TreeTest, SearchPagesCancelled)
+	{
+		populateTree(5, 100, BLOCK_SIZE * 2);
+
+		SearchOptions options;
+		options.control = make_shared<QueryControl>();
+		options.control->cancel();
+
+		vector<bytes> returned;
+		auto token = tree->search(10, 90, 10, returned, options);
+		EXPECT_EQ(0, returned.size());
+		EXPECT_TRUE(options.control->truncated());
+
+		// the truncated page can be resumed
+		ASSERT_FALSE(token.empty());
+		while (!token.empty())
+		{
+			token = tree->resume(token, 10, returned);
+		}
+
+		vector<bytes> expected;
+		tree->search(10, 90, expected);
+		EXPECT_EQ(expected, returned);
+	}
+
+	TEST_P(TreeTest, SearchLimit)
+	{
+		populateTree(5, 100, BLOCK_SIZE * 2, 2);
+
+		for (auto limit : {0uLL, 1uLL, 5uLL, 1000uLL})
+		{
+			SearchOptions options;
+			options.limit = limit;
+
+			vector<bytes> all;
+			tree->search(10, ULLONG_MAX, all);
+			all.resize(min(limit, (number)all.size()));
+
+			vector<bytes> returned;
+			tree->search(10, ULLONG_MAX, returned, options);
+			EXPECT_EQ(all, returned);
+
+			returned.clear();
+			tree->searchParallel(10, ULLONG_MAX, returned, 4, options);
+			EXPECT_EQ(all, returned);
+
+			vector<vector<bytes>> batch;
+			tree->search(vector<number>{10, 20}, batch, options);
+			EXPECT_EQ(min(limit, 2uLL), batch[1].size());
+
+			vector<pair<number, number>> ranges = {{10, 20}, {50, ULLONG_MAX}};
+			tree->search(ranges, batch, options);
+			EXPECT_EQ(min(limit, 22uLL), batch[0].size());
+			EXPECT_EQ(min(limit, 102uLL), batch[1].size());
+		}
+	}
+
+	TEST_P(TreeTest, SearchLimitReads)
+	{
+		// the payloads fit in a single storage block
+		populateTree(5, 1000, BLOCK_SIZE / 4);
+
+		auto reads	  = make_shared<CachedStorageAdapter>(storage, 0);
+		auto reloaded = make_unique<Tree>(reads);
+
+		SearchOptions options;
+		options.limit = 10;
+
+		auto misses = reads->misses();
+		vector<bytes> returned;
+		reloaded->search(100, ULLONG_MAX, returned, options);
+
+		EXPECT_EQ(10, returned.size());
+		// the descent (the tree is at most 7 levels deep) and the ten Data Blocks, not one more
+		EXPECT_LE(reads->misses() - misses, 7 + 10);
+
+		// the parallel search is not split, the other sub-ranges would read ten Data Blocks each
+		reads	 = make_shared<CachedStorageAdapter>(storage, 0);
+		reloaded = make_unique<Tree>(reads);
+		misses	 = reads->misses();
+		returned.clear();
+		reloaded->searchParallel(100, ULLONG_MAX, returned, 4, options);
+
+		EXPECT_EQ(10, returned.size());
+		EXPECT_LE(reads->misses() - misses, 7 + 10);
+	}
+
+	TEST_P(TreeTest, SearchReadAheadWindows)
+	{
+		// the payloads span five storage blocks, the scans cross several windows
+		auto recording = make_shared<AdviceRecordingStorageAdapter>(BLOCK_SIZE);
+		storage		   = recording;
+		populateTree(5, 300, 5 * BLOCK_SIZE);
+
+		auto check = [&recording]() {
+			ASSERT_GT(recording->windows.size(), 2);
+			for (auto read : recording->reads)
+			{
+				auto inside = any_of(recording->windows.begin(), recording->windows.end(), [read](const pair<number, number> &window) { return read >= window.first && read < window.second; });
+				EXPECT_TRUE(inside) << "the block " << read << " is read outside of the advised windows";
+			}
+			recording->windows.clear();
+			recording->reads.clear();
+		};
+
+		vector<bytes> returned;
+		tree->search(5, 300, returned);
+		ASSERT_EQ(296, returned.size());
+		check();
+
+		returned.clear();
+		auto token = tree->search(5, 300, 1000, returned);
+		ASSERT_EQ(296, returned.size());
+		ASSERT_TRUE(token.empty());
+		check();
+	}
+
+	TEST_P(TreeTest, SearchLimitResultCache)
+	{
+		populateTree(5, 100);
+		tree->setResultCache(make_shared<ResultCache>(1uLL << 20));
+
+		SearchOptions options;
+		options.limit = 3;
+
+		for (auto i = 0; i < 3; i++)
+		{
+			vector<bytes> limited, all;
+			tree->search(10, 20, limited, options);
+			tree->search(10, 20, all);
+
+			EXPECT_EQ(3, limited.size());
+			EXPECT_EQ(11, all.size());
+		}
+	}
+
+	TEST_P(TreeTest, SearchConditions)
+	{
+		auto data = populateTree(5, 100, BLOCK_SIZE * 2);
+
+		auto filter = [&data](function<bool(const bytes &)> condition) {
+			vector<bytes> result;
+			for (auto &[key, payload] : data)
+			{
+				if (key >= 10 && key <= 90 && condition(payload))
+				{
+					result.push_back(payload);
+				}
+			}
+			return result;
+		};
+
+		SearchOptions options;
+		options.conditions = {{0, fromText("2", 1)}};
+		vector<bytes> returned;
+		tree->search(10, 90, returned, options);
+		EXPECT_EQ(filter([](const bytes &payload) { return payload[0] == '2'; }), returned);
+		EXPECT_EQ(10, returned.size());
+
+		// combined, with the projection
+		options.conditions = {{0, fromText("3", 1), PayloadCondition::GreaterOrEqual}, {1, fromText("5", 1), PayloadCondition::Less}};
+		options.offset	   = 1;
+		options.length	   = 2;
+		returned.clear();
+		tree->search(10, 90, returned, options);
+		auto expected = filter([](const bytes &payload) { return payload[0] >= '3' && payload[1] < '5'; });
+		for (auto &payload : expected)
+		{
+			payload = bytes(payload.begin() + 1, payload.begin() + 3);
+		}
+		EXPECT_EQ(expected, returned);
+		EXPECT_EQ(6 * 5 + 1, returned.size());
+	}
+
+	TEST_P(TreeTest, SearchPredicate)
+	{
+		populateTree(5, 100, BLOCK_SIZE * 2, 2);
+
+		SearchOptions options;
+		options.predicate = [](number key, const uchar *data, number size) { return key % 2 == 0 && data[0] != '1'; };
+		auto expected	  = [](number from, number to, number limit) {
+			vector<bytes> result;
+			for (auto key = from; key <= to && result.size() < limit; key++)
+			{
+				if (key % 2 == 0 && to_string(key)[0] != '1')
+				{
+					result.push_back(generateDataBytes(to_string(key), BLOCK_SIZE * 2));
+					result.push_back(generateDataBytes(to_string(key), BLOCK_SIZE * 2));
+				}
+			}
+			result.resize(min(limit, (number)result.size()));
+			return result;
+		};
+
+		vector<bytes> returned;
+		tree->search(5, 30, returned, options);
+		EXPECT_EQ(expected(5, 30, ULLONG_MAX), returned);
+
+		// the limit counts the matching records only
+		options.limit = 5;
+		returned.clear();
+		tree->search(5, 100, returned, options);
+		EXPECT_EQ(expected(5, 100, 5), returned);
+
+		vector<vector<bytes>> batch;
+		tree->search(vector<number>{6, 7, 12, 20}, batch, options);
+		EXPECT_EQ(vector<number>({2, 0, 0, 2}), vector<number>({batch[0].size(), batch[1].size(), batch[2].size(), batch[3].size()}));
+
+		options.limit = ULLONG_MAX;
+		vector<pair<number, number>> ranges = {{5, 30}, {40, 50}};
+		tree->search(ranges, batch, options);
+		EXPECT_EQ(expected(5, 30, ULLONG_MAX), batch[0]);
+		EXPECT_EQ(expected(40, 50, ULLONG_MAX), batch[1]);
+
+		returned.clear();
+		auto token = tree->search(5, 100, 3, returned, options);
+		while (!token.empty())
+		{
+			token = tree->resume(token, 3, returned, options);
+		}
+		EXPECT_EQ(expected(5, 100, ULLONG_MAX), returned);
+	}
+
+	TEST_P(TreeTest, SearchConditionsInvalid)
+	{
+		populateTree(5, 15, 10);
+
+		SearchOptions options;
+		vector<bytes> returned;
+
+		// the payloads are too short
+		options.conditions = {{12, fromText("1", 1)}};
+		tree->search(5, 15, returned, options);
+		EXPECT_EQ(0, returned.size());
+
+		options.conditions = {{BLOCK_SIZE, fromText("1", 1)}};
+		ASSERT_THROW_CONTAINS(tree->search(5, 15, returned, options), "past the first storage block");
+
+		// the end of the condition overflows
+		options.conditions = {{ULLONG_MAX - 1, fromText("1", 4)}};
+		ASSERT_THROW_CONTAINS(tree->search(5, 15, returned, options), "past the first storage block");
+	}
+
+	TEST_P(TreeTest, SplitKeys)
+	{
+		populateTree(5, 60);
+
+		for (auto parts : {2uLL, 4uLL, 10uLL})
+		{
+			auto keys = tree->splitKeys(10, 50, parts);
+
+			EXPECT_EQ(parts - 1, keys.size());
+			EXPECT_TRUE(is_sorted(keys.begin(), keys.end()));
+			for (auto key : keys)
+			{
+				EXPECT_GE(key, 10);
+				EXPECT_LT(key, 50);
+			}
+		}
+
+		EXPECT_EQ(0, tree->splitKeys(20, 20, 4).size());
+		EXPECT_EQ(0, tree->splitKeys(70, 80, 4).size());
+	}
+
+	TEST_P(TreeTest, ParallelSearchStream)
+	{
+		populateTree(5, 60, BLOCK_SIZE * 2);
+
+		SearchOptions options;
+		options.offset = 10;
+		options.length = BLOCK_SIZE;
+
+		vector<bytes> expected;
+		tree->search(5, 60, expected, options);
+
+		vector<number> keys;
+		vector<bytes> returned;
+		auto fresh = true;
+		tree->searchParallel(
+			5,
+			60,
+			[&returned, &keys, &fresh](number key, const uchar *data, number size, bool last) {
+				if (fresh)
+				{
+					returned.push_back(bytes());
+					keys.push_back(key);
+				}
+				returned.back().insert(returned.back().end(), data, data + size);
+				fresh = last;
+			},
+			4,
+			options);
+
+		ASSERT_EQ(expected, returned);
+		ASSERT_TRUE(is_sorted(keys.begin(), keys.end()));
+	}
+
+	TEST_P(TreeTest, PinLevels)
+	{
+		populateTree(5, 60, 100, 2);
+
+		vector<bytes> expected;
+		tree->search(5, 60, expected);
+
+		for (auto replicate : {false, true})
+		{
+			for (number levels = 0; levels <= tree->height + 1; levels++)
+			{
+				tree->pinLevels(levels, replicate);
+
+				vector<bytes> returned;
+				tree->search(5, 60, returned);
+				EXPECT_EQ(expected, returned);
+
+				vector<vector<bytes>> batch;
+				tree->search({10, 20}, batch);
+				EXPECT_EQ(2, batch[0].size());
+			}
+		}
+
+		// with the root pinned, the stored root is not read anymore
+		tree->pinLevels(1);
+		bytes root;
+		storage->get(tree->root, root);
+		root[0] = 0xff;
+		storage->set(tree->root, root);
+
+		vector<bytes> returned;
+		tree->search(5, 60, returned);
+		EXPECT_EQ(expected, returned);
+	}
+
+	TEST_P(TreeTest, AsyncSearch)
+	{
+		populateTree(5, 15, 100, 2);
+
+		vector<future<vector<bytes>>> futures;
+		for (number key = 0; key < 20; key++)
+		{
+			futures.push_back(tree->searchAsync(key));
+		}
+		auto range = tree->searchAsync(8, 11);
+
+		for (number key = 0; key < 20; key++)
+		{
+			vector<bytes> expected;
+			tree->search(key, expected);
+
+			EXPECT_EQ(expected, futures[key].get());
+		}
+
+		vector<bytes> expected;
+		tree->search(8, 11, expected);
+		EXPECT_EQ(expected, range.get());
+	}
+
+	TEST_P(TreeTest, AsyncSearchCallback)
+	{
+		populateTree();
+
+		promise<vector<bytes>> done;
+		tree->searchAsync(
+			8,
+			11,
+			[&done](vector<bytes> response, exception_ptr error) {
+				EXPECT_FALSE(error);
+				done.set_value(response);
+			});
+
+		vector<bytes> expected;
+		tree->search(8, 11, expected);
+		ASSERT_EQ(expected, done.get_future().get());
+	}
+
+	TEST_P(TreeTest, AsyncSearchRejected)
+	{
+		populateTree();
+
+		auto pool = make_shared<ThreadPool>(1, 1);
+		tree->setThreadPool(pool);
+
+		promise<void> release;
+		auto released = release.get_future().share();
+		ASSERT_TRUE(pool->submit([released]() { released.wait(); }));
+
+		auto rejected = tree->searchAsync(10);
+		release.set_value();
+
+		ASSERT_THROW_CONTAINS(rejected.get(), "in flight");
+	}
+
+	TEST_P(TreeTest, AsyncSearchReleasesTree)
+	{
+		populateTree();
+
+		// the callbacks hold the only references, so the tree (and its own pool) is destroyed on the pool's thread
+		shared_ptr<Tree> shared = move(tree);
+		weak_ptr<Tree> observer = shared;
+
+		promise<void> done;
+		auto holder = make_shared<shared_ptr<Tree>>(shared);
+		shared->searchAsync(
+			8,
+			11,
+			[holder, &done](vector<bytes> response, exception_ptr error) {
+				// released in the callback
+				holder->reset();
+				done.set_value();
+			});
+		shared->searchAsync(
+			8,
+			11,
+			[shared](vector<bytes> response, exception_ptr error) {
+				// released with the task
+			});
+		shared.reset();
+		done.get_future().wait();
+
+		for (auto i = 0; i < 500 && !observer.expired(); i++)
+		{
+			this_thread::sleep_for(chrono::milliseconds(10));
+		}
+		EXPECT_TRUE(observer.expired());
+	}
+
+	TEST_P(TreeTest, AsyncSearchDropNoWait)
+	{
+		populateTree();
+
+		auto pool = make_shared<ThreadPool>(1, 10);
+		tree->setThreadPool(pool);
+		shared_ptr<Tree> shared = move(tree);
+
+		promise<void> release;
+		auto released = release.get_future().share();
+		ASSERT_TRUE(pool->submit([released]() { released.wait(); }));
+
+		// the search is queued behind the blocked task, dropping the tree does not wait for it
+		auto found	 = shared->searchAsync(10);
+		auto dropped = async(launch::async, [&shared]() { shared.reset(); });
+		EXPECT_EQ(future_status::ready, dropped.wait_for(chrono::seconds(1)));
+
+		release.set_value();
+		dropped.wait();
+		EXPECT_EQ(1, found.get().size());
+	}
+
+	TEST_P(TreeTest, BasicSearchRangeDuplicates)
+	{
+		const auto start	  = 8uLL;
+		const auto end		  = 11uLL;
+		const auto duplicates = 3;
+
+		auto data = populateTree(5, 15, 100, duplicates);
+
+		vector<bytes> returned;
+		tree->search(start, end, returned);
+
+		vector<bytes> expected;
+		auto i = data.begin();
+		while (i != data.end())
+		{
+			i = find_if(
+				i,
+				data.end(),
+				[](const pair<number, bytes>& val) {
+					return val.first >= start && val.first <= end;
+				});
+			if (i != data.end())
+			{
+				auto element = (*i).second;
+				expected.push_back(element);
+				i++;
+			}
+		}
+		ASSERT_EQ(expected, returned);
+	}
+
+	TEST_P(TreeTest, BasicSearchAll)
+	{
+		const auto start = 5uLL;
+		const auto end	 = 15uLL;
+
+		auto data = populateTree();
+
+		vector<bytes> returned;
+		tree->search(start, end, returned);
+
+		vector<bytes> expected;
+		expected.resize(data.size());
+
+		transform(
+			data.begin(),
+			data.end(),
+			expected.begin(),
+			[](pair<number, bytes> val) { return val.second; });
+
+		ASSERT_EQ(expected, returned);
+	}
+
+	TEST_P(TreeTest, SearchRangeProjection)
+	{
+		const auto start  = 8uLL;
+		const auto end	  = 11uLL;
+		const auto offset = 3uLL;
+		const auto length = 20uLL;
+
+		auto data = populateTree(5, 15, BLOCK_SIZE * 3);
+
+		SearchOptions options;
+		options.offset = offset;
+		options.length = length;
+
+		vector<bytes> returned;
+		tree->search(start, end, returned, options);
+
+		vector<bytes> expected;
+		for (auto [key, payload] : data)
+		{
+			if (key >= start && key <= end)
+			{
+				expected.push_back(bytes(payload.begin() + offset, payload.begin() + offset + length));
+			}
+		}
+
+		ASSERT_EQ(expected, returned);
+	}
+
+	TEST_P(TreeTest, SearchRangeStream)
+	{
+		const auto start = 8uLL;
+		const auto end	 = 11uLL;
+
+		auto data = populateTree(5, 15, BLOCK_SIZE * 3, 2);
+
+		vector<pair<number, bytes>> returned;
+		auto fresh = true;
+		tree->search(
+			start,
+			end,
+			[&returned, &fresh](number key, const uchar *chunk, number size, bool last) {
+				// no slice is larger than a storage block
+				EXPECT_LE(size, BLOCK_SIZE);
+				if (fresh)
+				{
+					returned.push_back({key, bytes()});
+				}
+				EXPECT_EQ(key, returned.back().first);
+				returned.back().second.insert(returned.back().second.end(), chunk, chunk + size);
+				fresh = last;
+			});
+
+		vector<pair<number, bytes>> expected;
+		copy_if(
+			data.begin(),
+			data.end(),
+			back_inserter(expected),
+			[](const pair<number, bytes> &val) {
+				return val.first >= start && val.first <= end;
+			});
+
+		ASSERT_TRUE(fresh);
+		ASSERT_EQ(expected, returned);
+	}
+
+	TEST_P(TreeTest, SearchRangeDescriptor)
+	{
+		const auto start = 8uLL;
+		const auto end	 = 11uLL;
+
+		auto data = populateTree(5, 15, BLOCK_SIZE * 3);
+
+		auto file	 = tmpfile();
+		auto written = tree->search(start, end, fileno(file));
+
+		bytes expected;
+		for (auto [key, payload] : data)
+		{
+			if (key >= start && key <= end)
+			{
+				expected.insert(expected.end(), payload.begin(), payload.end());
+			}
+		}
+		ASSERT_EQ(expected.size(), written);
+
+		bytes returned(written);
+		rewind(file);
+		ASSERT_EQ(written, fread(returned.data(), 1, written, file));
+		fclose(file);
+
+		ASSERT_EQ(expected, returned);
+	}
+
+	TEST_P(TreeTest, SearchRangeDescriptorInvalid)
+	{
+		populateTree();
+
+		ASSERT_THROW_CONTAINS(tree->search(5, 15, -1), "cannot write");
+	}
+
+	/**
+	 * @brief collects the payloads streamed by the join, each with its key
+	 */
+	PayloadConsumer collect(vector<pair<number, bytes>> &matches)
+	{
+		auto fresh = make_shared<bool>(true);
+		return [&matches, fresh](number key, const uchar *data, number size, bool last) {
+			if (*fresh)
+			{
+				matches.push_back({key, bytes()});
+			}
+			matches.back().second.insert(matches.back().second.end(), data, data + size);
+			*fresh = last;
+		};
+	}
+
+	TEST_P(TreeTest, Join)
+	{
+		populateTree(5, 100, BLOCK_SIZE * 2, 2);
+
+		// sorted, with repeats, gaps and keys outside the tree, then one out of order
+		vector<number> probes = {1, 5, 5, 6, 9, 10, 50, 51, 52, 99, 100, 101, 300, 20};
+
+		vector<pair<number, bytes>> matches;
+		auto next	 = 0u;
+		auto matched = tree->join(
+			[&probes, &next](number &key) {
+				if (next == probes.size())
+				{
+					return false;
+				}
+				key = probes[next++];
+				return true;
+			},
+			collect(matches));
+
+		vector<pair<number, bytes>> expected;
+		for (auto probe : probes)
+		{
+			vector<bytes> found;
+			tree->search(probe, found);
+			for (auto &payload : found)
+			{
+				expected.push_back({probe, payload});
+			}
+		}
+
+		EXPECT_EQ(expected.size(), matched);
+		EXPECT_EQ(expected, matches);
+	}
+
+	TEST_P(TreeTest, JoinDescriptor)
+	{
+		populateTree(5, 100, BLOCK_SIZE * 2);
+
+		vector<number> probes;
+		for (number key = 0; key < 1000; key += 1 + rand() % 3)
+		{
+			probes.push_back(key);
+		}
+
+		auto file = tmpfile();
+		ASSERT_EQ(probes.size(), fwrite(probes.data(), sizeof(number), probes.size(), file));
+		fflush(file);
+		rewind(file);
+
+		vector<pair<number, bytes>> matches;
+		auto matched = tree->join(fileno(file), collect(matches));
+		fclose(file);
+
+		auto expected = count_if(probes.begin(), probes.end(), [](number key) { return key >= 5 && key <= 100; });
+		EXPECT_EQ(expected, matched);
+		ASSERT_EQ(expected, matches.size());
+		for (auto &[key, payload] : matches)
+		{
+			EXPECT_EQ(generateDataBytes(to_string(key), BLOCK_SIZE * 2), payload);
+		}
+	}
+
+	TEST_P(TreeTest, JoinDescriptorPartialReads)
+	{
+		populateTree(5, 100, BLOCK_SIZE * 2);
+
+		int descriptors[2];
+		ASSERT_EQ(0, pipe(descriptors));
+
+		// the first key arrives in two parts, the second only once the first has been joined
+		atomic<bool> joined = false;
+		auto early			= false;
+		thread producer([&descriptors, &joined, &early]() {
+			number first = 10, second = 20;
+			write(descriptors[1], (uchar *)&first, 3);
+			this_thread::sleep_for(chrono::milliseconds(10));
+			write(descriptors[1], (uchar *)&first + 3, sizeof(number) - 3);
+
+			for (auto i = 0; i < 500 && !joined; i++)
+			{
+				this_thread::sleep_for(chrono::milliseconds(10));
+			}
+			early = joined;
+			write(descriptors[1], (uchar *)&second, sizeof(number));
+			close(descriptors[1]);
+		});
+
+		vector<number> keys;
+		auto matched = tree->join(descriptors[0], [&keys, &joined](number key, const uchar *data, number size, bool last) {
+			if (last)
+			{
+				keys.push_back(key);
+				joined = true;
+			}
+		});
+		producer.join();
+		close(descriptors[0]);
+
+		EXPECT_TRUE(early);
+		EXPECT_EQ(2, matched);
+		EXPECT_EQ(vector<number>({10, 20}), keys);
+	}
+
+	TEST_P(TreeTest, JoinDescriptorPartialKey)
+	{
+		populateTree();
+
+		auto file = tmpfile();
+		number key = 10;
+		ASSERT_EQ(1, fwrite(&key, sizeof(number), 1, file));
+		ASSERT_EQ(1, fwrite(&key, 3, 1, file));
+		fflush(file);
+		rewind(file);
+
+		ASSERT_THROW_CONTAINS(tree->join(fileno(file), [](number key, const uchar *data, number size, bool last) {}), "middle of a key");
+		fclose(file);
+	}
+
+	TEST_P(TreeTest, JoinDescriptorInvalid)
+	{
+		populateTree();
+
+		ASSERT_THROW_CONTAINS(tree->join(-1, [](number key, const uchar *data, number size, bool last) {}), "cannot read");
+	}
+
+	TEST_P(TreeTest, JoinTrees)
+	{
+		const auto start = 10uLL;
+		const auto end	 = 60uLL;
+
+		auto data = populateTree(5, 80, BLOCK_SIZE * 2, 2);
+
+		// every third key, with three duplicates of its own
+		vector<pair<number, bytes>> otherData;
+		for (number key = 0; key < 100; key += 3)
+		{
+			for (auto i = 0; i < 3; i++)
+			{
+				otherData.push_back({key, generateDataBytes(to_string(key) + "other", BLOCK_SIZE)});
+			}
+		}
+		auto otherStorage = make_shared<InMemoryStorageAdapter>(BLOCK_SIZE);
+		auto other		  = make_unique<Tree>(otherStorage, otherData);
+
+		for (auto distance : {0uLL, 2uLL, 100uLL})
+		{
+			vector<tuple<number, bytes, number, bytes>> expected;
+			for (auto &[key, payload] : data)
+			{
+				for (auto &[otherKey, otherPayload] : otherData)
+				{
+					if (key >= start && key <= end && max(key, otherKey) - min(key, otherKey) <= distance)
+					{
+						expected.push_back({key, payload, otherKey, otherPayload});
+					}
+				}
+			}
+
+			for (auto threads : {1uLL, 4uLL})
+			{
+				vector<tuple<number, bytes, number, bytes>> matches;
+				auto matched = tree->join(
+					*other,
+					start,
+					end,
+					distance,
+					[&matches](number key, const bytes &payload, number otherKey, const bytes &otherPayload) {
+						matches.push_back({key, payload, otherKey, otherPayload});
+					},
+					threads);
+
+				EXPECT_EQ(expected.size(), matched);
+				EXPECT_EQ(expected, matches);
+			}
+		}
+	}
+
+	TEST_P(TreeTest, JoinTreesDisjoint)
+	{
+		populateTree(5, 15);
+
+		auto otherData	  = generateDataPoints(20, 30, 100);
+		auto otherStorage = make_shared<InMemoryStorageAdapter>(BLOCK_SIZE);
+		auto other		  = make_unique<Tree>(otherStorage, otherData);
+
+		auto consumer = [](number key, const bytes &payload, number otherKey, const bytes &otherPayload) {
+			FAIL();
+		};
+		EXPECT_EQ(0, tree->join(*other, 0, 100, 0, consumer));
+		EXPECT_EQ(0, other->join(*tree, 0, 100, 4, consumer));
+		EXPECT_EQ(0, tree->join(*other, 15, 10, 100, consumer));
+	}
+
+	TEST_P(TreeTest, SearchRangeNoCache)
+	{
+		auto cache = make_shared<CachedStorageAdapter>(storage, 1000);
+		storage	   = cache;
+		auto data  = populateTree(5, 60, BLOCK_SIZE * 2);
+
+		SearchOptions options;
+		options.cache = false;
+
+		vector<bytes> returned;
+		tree->search(5, 60, returned, options);
+		// only the descent path and the first data block are admitted
+		auto once = cache->cached();
+
+		vector<bytes> expected;
+		tree->search(5, 60, expected);
+
+		ASSERT_EQ(expected, returned);
+		ASSERT_LT(once, 10);
+		ASSERT_GT(cache->cached(), once + data.size());
+	}
+
+	TEST_P(TreeTest, SearchResultCache)
+	{
+		auto data  = populateTree(5, 15, 100, 2);
+		auto cache = make_shared<ResultCache>(1 << 20);
+		tree->setResultCache(cache);
+
+		for (auto i = 0; i < 3; i++)
+		{
+			vector<bytes> key;
+			tree->search(10, key);
+			EXPECT_EQ(2, key.size());
+
+			vector<bytes> range;
+			tree->search(8, 11, range);
+			EXPECT_EQ(8, range.size());
+		}
+		EXPECT_EQ(4, cache->hits());
+
+		SearchOptions options;
+		options.length = 10;
+
+		vector<bytes> projected;
+		tree->search(10, projected, options);
+		EXPECT_EQ(10, projected[0].size());
+	}
+
+	TEST_P(TreeTest, WarmUp)
+	{
+		auto cache = make_shared<CachedStorageAdapter>(storage, 1000);
+		storage	   = cache;
+		populateTree(5, 60);
+
+		// reopen the tree, as after a restart
+		auto reopened = make_shared<CachedStorageAdapter>(cache, 1000);
+		auto warmSet  = cache->hotSet();
+		tree		  = make_unique<Tree>(reopened);
+
+		auto warming = tree->warmUp(2, warmSet);
+
+		// serves while warming up
+		vector<bytes> returned;
+		tree->search(5, 60, returned);
+		EXPECT_EQ(56, returned.size());
+
+		warming.get();
+		EXPECT_GE(reopened->cached(), warmSet.size());
+
+		auto misses = reopened->misses();
+		returned.clear();
+		tree->search(5, 60, returned);
+		EXPECT_EQ(misses, reopened->misses());
 	}
 
 	TEST_P(TreeTest, SearchAllDisaster)
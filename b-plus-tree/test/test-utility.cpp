@@ -86,6 +86,43 @@ namespace BPlusTree
 		EXPECT_EQ(second, deconstructed[1]);
 		EXPECT_EQ(third, deconstructed[2]);
 	}
+
+	TEST_F(UtilityTest, DeconstructNumbersPartial)
+	{
+		auto data = concatNumbers(1, 56uLL);
+		data.resize(10);
+
+		auto deconstructed = deconstructNumbers(data);
+
+		ASSERT_EQ(1, deconstructed.size());
+		EXPECT_EQ(56uLL, deconstructed[0]);
+	}
+
+	TEST_F(UtilityTest, SipHash)
+	{
+		// the reference vector: key 00 01 .. 0f, message 00 01 .. 0f
+		pair<number, number> key = {0x0706050403020100uLL, 0x0f0e0d0c0b0a0908uLL};
+
+		EXPECT_EQ(0x726fdb47dd0e0e31uLL, sipHash(key, {}));
+		EXPECT_EQ(0x3f2acc7f57c29bdbuLL, sipHash(key, {0x0706050403020100uLL, 0x0f0e0d0c0b0a0908uLL}));
+		EXPECT_NE(sipHash(key, {1, 2}), sipHash({0, 0}, {1, 2}));
+	}
+
+	TEST_F(UtilityTest, NumaTopology)
+	{
+		auto nodes = numaTopology();
+
+		ASSERT_LE(1, nodes.size());
+
+		// the CPU of this thread belongs to one of the nodes
+		auto cpu   = (uint)sched_getcpu();
+		auto found = false;
+		for (auto &cpus : nodes)
+		{
+			found = found || find(cpus.begin(), cpus.end(), cpu) != cpus.end();
+		}
+		ASSERT_TRUE(found);
+	}
 }
 
 int main(int argc, char** argv)